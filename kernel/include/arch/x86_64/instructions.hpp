@@ -5,6 +5,7 @@
 #ifndef FOROS_X86_64_INSTRUCTIONS_HPP
 #define FOROS_X86_64_INSTRUCTIONS_HPP
 
+#include <cstddef>
 #include <cstdint>
 #include <arch/x86_64/types.hpp>
 
@@ -93,6 +94,9 @@ namespace foros::x86_64::instructions
     {
         asm volatile(
         "sti"
+        : /* no output operands */
+        : /* no input operands */
+        : "memory"
         );
     }
 
@@ -101,6 +105,82 @@ namespace foros::x86_64::instructions
     {
         asm volatile(
         "cli"
+        : /* no output operands */
+        : /* no input operands */
+        : "memory"
+        );
+    }
+
+    /** Fill count 8-byte words at dest with value */
+    inline void rep_stosq(void *dest, uint64_t value, std::size_t count) noexcept
+    {
+        asm volatile(
+        "rep stosq"
+        : "+D"(dest), "+c"(count)
+        : "a"(value)
+        : "memory"
+        );
+    }
+
+    /** Query processor information for a given leaf (and subleaf) */
+    inline types::cpuid_result cpuid(uint32_t leaf, uint32_t subleaf = 0) noexcept
+    {
+        types::cpuid_result ret;
+
+        asm volatile(
+        "cpuid"
+        : "=a"(ret.eax), "=b"(ret.ebx), "=c"(ret.ecx), "=d"(ret.edx)
+        : "a"(leaf), "c"(subleaf)
+        );
+        return ret;
+    }
+
+    /** Read the time-stamp counter */
+    inline uint64_t rdtsc() noexcept
+    {
+        uint32_t low;
+        uint32_t high;
+
+        asm volatile(
+        "rdtsc"
+        : "=a"(low), "=d"(high)
+        );
+        return (uint64_t(high) << 32) | low;
+    }
+
+    /** Read a model-specific register */
+    inline uint64_t rdmsr(uint32_t msr) noexcept
+    {
+        uint32_t low;
+        uint32_t high;
+
+        asm volatile(
+        "rdmsr"
+        : "=a"(low), "=d"(high)
+        : "c"(msr)
+        );
+        return (uint64_t(high) << 32) | low;
+    }
+
+    /** Write a model-specific register */
+    inline void wrmsr(uint32_t msr, uint64_t value) noexcept
+    {
+        asm volatile(
+        "wrmsr"
+        : /* no output registers */
+        : "c"(msr), "a"(static_cast<uint32_t>(value)), "d"(static_cast<uint32_t>(value >> 32))
+        : "memory"
+        );
+    }
+
+    /** Write back and invalidate every cache of the current CPU */
+    inline void wbinvd() noexcept
+    {
+        asm volatile(
+        "wbinvd"
+        : /* no output registers */
+        : /* no input registers */
+        : "memory"
         );
     }
 
@@ -28,6 +28,54 @@ namespace foros::x86_64::registers
         );
         return ret;
     }
+
+    inline std::uintptr_t cr3() noexcept
+    {
+        std::uintptr_t ret;
+
+        asm volatile("mov %%cr3, %0"
+        : "=r"(ret)
+        );
+        return ret;
+    }
+
+    inline void set_cr3(std::uintptr_t value) noexcept
+    {
+        asm volatile("mov %0, %%cr3"
+        : /* no output registers */
+        : "r"(value)
+        : "memory"
+        );
+    }
+
+    inline std::uintptr_t cr4() noexcept
+    {
+        std::uintptr_t ret;
+
+        asm volatile("mov %%cr4, %0"
+        : "=r"(ret)
+        );
+        return ret;
+    }
+
+    inline std::uint64_t rflags() noexcept
+    {
+        std::uint64_t ret;
+
+        asm volatile("pushfq\n\tpop %0"
+        : "=r"(ret)
+        );
+        return ret;
+    }
+
+    inline void set_cr4(std::uintptr_t value) noexcept
+    {
+        asm volatile("mov %0, %%cr4"
+        : /* no output registers */
+        : "r"(value)
+        : "memory"
+        );
+    }
 }
 
 #endif /* !FOROS_X86_64_REGISTERS_HPP */
@@ -14,6 +14,15 @@ namespace foros::x86_64::types
         std::uint16_t limit;
         std::uintptr_t base_ptr;
     };
+
+    /** Registers returned by the cpuid instruction */
+    struct cpuid_result
+    {
+        std::uint32_t eax;
+        std::uint32_t ebx;
+        std::uint32_t ecx;
+        std::uint32_t edx;
+    };
 }
 
 #endif /* !FOROS_X86_64_TYPES_HPP */
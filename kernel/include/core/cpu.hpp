@@ -0,0 +1,73 @@
+/*
+** Created by doom on 18/10/26.
+*/
+
+#ifndef FOROS_CORE_CPU_HPP
+#define FOROS_CORE_CPU_HPP
+
+#include <cstddef>
+#include <arch/x86_64/instructions.hpp>
+
+namespace foros
+{
+    /** Maximum number of CPUs for which per-CPU data is reserved */
+    static constexpr const std::size_t max_cpus = 16;
+
+    /** Size of a cache line, used to keep per-CPU data from sharing lines */
+    static constexpr const std::size_t cache_line_size = 64;
+
+    /**
+     * Get the index of the CPU running the caller
+     *
+     * Only the bootstrap processor is started for now, so this is always 0.
+     *
+     * @return              the index of the current CPU, below max_cpus
+     */
+    inline std::size_t current_cpu_index() noexcept
+    {
+        return 0;
+    }
+
+    /**
+     * Check whether the CPU can tag TLB entries with process-context identifiers
+     *
+     * @return              if PCIDs are supported, true
+     *                      otherwise, false
+     */
+    inline bool cpu_supports_pcid() noexcept
+    {
+        /** CPUID.01H:ECX.PCID [bit 17] */
+        return (x86_64::instructions::cpuid(0x1).ecx & (1u << 17)) != 0;
+    }
+
+    /**
+     * Check whether the CPU has a page attribute table, which selects the memory type of each mapping
+     *
+     * @return              if the PAT is supported, true
+     *                      otherwise, false
+     */
+    inline bool cpu_supports_pat() noexcept
+    {
+        /** CPUID.01H:EDX.PAT [bit 16] */
+        return (x86_64::instructions::cpuid(0x1).edx & (1u << 16)) != 0;
+    }
+
+    /**
+     * Check whether the CPU can map 1GB pages
+     *
+     * @return              if 1GB pages are supported, true
+     *                      otherwise, false
+     */
+    inline bool cpu_supports_1g_pages() noexcept
+    {
+        namespace instr = x86_64::instructions;
+
+        if (instr::cpuid(0x80000000).eax < 0x80000001) {
+            return false;
+        }
+        /** CPUID.80000001H:EDX.Page1GB [bit 26] */
+        return (instr::cpuid(0x80000001).edx & (1u << 26)) != 0;
+    }
+}
+
+#endif /* !FOROS_CORE_CPU_HPP */
@@ -5,6 +5,8 @@
 #ifndef FOROS_HALTED_LOOP_HPP
 #define FOROS_HALTED_LOOP_HPP
 
+#include <core/idle.hpp>
+
 namespace foros
 {
     template <typename Cond, typename Func>
@@ -12,6 +14,7 @@ namespace foros
     {
         while (cond) {
             f(cond);
+            idle_tasks::instance().run();
             asm volatile("hlt");
         }
     }
@@ -21,6 +24,7 @@ namespace foros
     {
         while (1) {
             f();
+            idle_tasks::instance().run();
             asm volatile("hlt");
         }
     }
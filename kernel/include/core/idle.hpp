@@ -0,0 +1,46 @@
+/*
+** Created by doom on 18/10/26.
+*/
+
+#ifndef FOROS_CORE_IDLE_HPP
+#define FOROS_CORE_IDLE_HPP
+
+#include <cstddef>
+#include <core/panic.hpp>
+#include <utils/singleton.hpp>
+
+namespace foros
+{
+    /**
+     * Background work run by the idle loop before halting the CPU.
+     *
+     * Tasks should only do a bounded amount of work per call, since pending events are not processed until
+     * they return.
+     */
+    class idle_tasks : public utils::singleton<idle_tasks>
+    {
+    public:
+        using task_type = void (*)();
+
+        static constexpr const std::size_t max_tasks = 8;
+
+        void add(task_type task) noexcept
+        {
+            kassert(_count < max_tasks, "idle_tasks::add: too many idle tasks");
+            _tasks[_count++] = task;
+        }
+
+        void run() noexcept
+        {
+            for (std::size_t i = 0; i < _count; ++i) {
+                _tasks[i]();
+            }
+        }
+
+    private:
+        task_type _tasks[max_tasks]{};
+        std::size_t _count{0};
+    };
+}
+
+#endif /* !FOROS_CORE_IDLE_HPP */
@@ -6,6 +6,7 @@
 #define FOROS_MASKABLE_INTERRUPTS_HPP
 
 #include <arch/x86_64/instructions.hpp>
+#include <arch/x86_64/registers.hpp>
 
 namespace foros
 {
@@ -20,6 +21,36 @@ namespace foros
     {
         arch::instructions::cli();
     }
+
+    /**
+     * Ignore maskable interrupts for the lifetime of the guard, restoring the previous state afterwards, so that
+     * the guards can be nested and used from interrupt handlers
+     */
+    class maskable_interrupts_guard
+    {
+    public:
+        /** Interrupt flag of the RFLAGS register */
+        static constexpr const uint64_t interrupt_flag = 1u << 9;
+
+        maskable_interrupts_guard() noexcept : _were_enabled((arch::registers::rflags() & interrupt_flag) != 0)
+        {
+            ignore_maskable_interrupts();
+        }
+
+        maskable_interrupts_guard(const maskable_interrupts_guard &) = delete;
+
+        maskable_interrupts_guard &operator=(const maskable_interrupts_guard &) = delete;
+
+        ~maskable_interrupts_guard() noexcept
+        {
+            if (_were_enabled) {
+                enable_maskable_interrupts();
+            }
+        }
+
+    private:
+        bool _were_enabled;
+    };
 }
 
 #endif /* !FOROS_MASKABLE_INTERRUPTS_HPP */
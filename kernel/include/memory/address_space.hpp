@@ -0,0 +1,244 @@
+/*
+** Created by doom on 18/10/26.
+*/
+
+#ifndef FOROS_MEMORY_ADDRESS_SPACE_HPP
+#define FOROS_MEMORY_ADDRESS_SPACE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <arch/x86_64/registers.hpp>
+#include <core/cpu.hpp>
+#include <core/panic.hpp>
+#include <utils/optional.hpp>
+#include <memory/definitions.hpp>
+#include <memory/paging.hpp>
+#include <memory/tlb.hpp>
+#include <memory/translation_cache.hpp>
+#include <memory/zeroed_frame_pool.hpp>
+
+namespace foros::memory
+{
+    /**
+     * An address space is a P4 table of its own, whose kernel entries are shared with every other address space.
+     * The P3 tables of the kernel entries are all created at boot, so the kernel entries are copied once, when an
+     * address space is created, and kernel mappings made from any address space are seen by all of them.
+     *
+     * The mapper always works on the active address space, through the recursive entry of its P4 table.
+     * When the CPU supports it, each address space gets its own PCID, so that switching between address spaces
+     * does not flush the TLB. The entries of an address space are then only flushed on its first activation, or
+     * when kernel pages were invalidated while it was inactive.
+     */
+    class address_space
+    {
+    public:
+        /** PCIDs are 12-bit long, and 0 is kept for the kernel address space */
+        static constexpr const std::size_t max_pcids = 4096;
+
+    private:
+        /** CR4.PCIDE */
+        static constexpr const uintptr_t cr4_pcid_enable = 1 << 17;
+        /** When writing CR3 with PCIDs enabled, keep the TLB entries tagged with the new PCID */
+        static constexpr const uintptr_t cr3_no_flush = 1UL << 63;
+        static constexpr const uintptr_t cr3_pcid_mask = 0xfff;
+
+        address_space(physical_frame p4, uint16_t pcid) noexcept : _p4(p4), _pcid(pcid)
+        {
+        }
+
+    public:
+        address_space(const address_space &) = delete;
+
+        address_space(address_space &&) noexcept = default;
+
+        /**
+         * Enable PCIDs if the CPU supports them. This must happen while the kernel address space is active.
+         */
+        static void initialize() noexcept
+        {
+            kernel();
+            if (cpu_supports_pcid()) {
+                arch::registers::set_cr4(arch::registers::cr4() | cr4_pcid_enable);
+                _pcid_enabled = true;
+            }
+        }
+
+        /** Get the address space set up by the boot code, to which the kernel P4 entries belong */
+        static address_space &kernel() noexcept
+        {
+            static address_space space(
+                physical_frame::for_address(physical_address(arch::registers::cr3() & ~cr3_pcid_mask)), 0);
+
+            return space;
+        }
+
+        static bool pcid_enabled() noexcept
+        {
+            return _pcid_enabled;
+        }
+
+        /**
+         * Create an empty address space, sharing the kernel entries
+         *
+         * @param al            the physical allocator used to allocate the P4 table
+         *
+         * @return              on success, an optional containing the address space
+         *                      on failure (out of memory or out of PCIDs), nullopt
+         */
+        template <typename FrameAllocator>
+        static utils::optional<address_space> create(FrameAllocator &al) noexcept
+        {
+            kassert(mapper::kernel_tables_preallocated(), "address_space::create: kernel tables are not preallocated");
+            auto pcid_opt = _allocate_pcid();
+            if (!pcid_opt) {
+                return std::nullopt;
+            }
+
+            auto frame_opt = al.allocate_frame();
+            if (!frame_opt) {
+                _release_pcid(pcid_opt.unwrap());
+                return std::nullopt;
+            }
+
+            address_space space(frame_opt.unwrap(), pcid_opt.unwrap());
+            zero_frame(space._p4);
+            space._table()[recursive_p4_index].set_frame(space._p4, page_table_entry::flags::present |
+                                                                    page_table_entry::flags::writable);
+            space._copy_kernel_entries();
+            return {std::move(space)};
+        }
+
+        /**
+         * Free the page tables of the user part of this address space, along with its P4 table and its PCID.
+         * The frames which are still mapped in it are not freed.
+         *
+         * @param al            the physical allocator to which the tables are given back
+         */
+        template <typename FrameAllocator>
+        void destroy(FrameAllocator &al) noexcept
+        {
+            kassert(!is_active(), "address_space::destroy: address space is active");
+            kassert(_pcid != 0, "address_space::destroy: the kernel address space cannot be destroyed");
+            auto &p4 = _table();
+
+            for (std::size_t i = 0; i < page_entries_count; ++i) {
+                if (!is_kernel_p4_index(i) && i != recursive_p4_index) {
+                    _free_tables(p4[i], 3, al);
+                }
+            }
+            al.deallocate_frame(_p4);
+            _release_pcid(_pcid);
+            _pcid = 0;
+        }
+
+        /**
+         * Make this address space the active one on the current CPU
+         */
+        void activate() noexcept
+        {
+            uintptr_t cr3 = _p4.start_address().value();
+
+            if (_pcid_enabled) {
+                cr3 |= _pcid;
+                /** Entries cached for this PCID are only valid if no kernel page was invalidated in the meantime */
+                if (!_needs_flush && _seen_kernel_generation == tlb_flush_batch::kernel_generation()) {
+                    cr3 |= cr3_no_flush;
+                }
+                _needs_flush = false;
+                _seen_kernel_generation = tlb_flush_batch::kernel_generation();
+            }
+            arch::registers::set_cr3(cr3);
+            translation_cache::instance().invalidate_all();
+        }
+
+        bool is_active() const noexcept
+        {
+            return (arch::registers::cr3() & ~cr3_pcid_mask & ~cr3_no_flush) == _p4.start_address().value();
+        }
+
+        physical_frame root_frame() const noexcept
+        {
+            return _p4;
+        }
+
+        uint16_t pcid() const noexcept
+        {
+            return _pcid;
+        }
+
+    private:
+        /** The P4 table is accessed through the direct map, since it might not be the active one */
+        p4_table &_table() const noexcept
+        {
+            kassert(is_direct_mapped(_p4), "address_space: P4 table is not direct-mapped");
+            return *reinterpret_cast<p4_table *>(phys_to_virt(_p4.start_address()).value());
+        }
+
+        /** Copy the kernel entries of the kernel P4 table, below which the tables are shared */
+        void _copy_kernel_entries() noexcept
+        {
+            const auto &kernel_p4 = kernel()._table();
+            auto &p4 = _table();
+
+            for (std::size_t i = 0; i < page_entries_count; ++i) {
+                if (is_kernel_p4_index(i)) {
+                    p4[i] = kernel_p4[i];
+                }
+            }
+        }
+
+        template <typename FrameAllocator>
+        static void _free_tables(const page_table_entry &entry, std::size_t level, FrameAllocator &al) noexcept
+        {
+            if (!entry.entry_flags().has(page_table_entry::flags::present) || entry.is_huge_page()) {
+                return;
+            }
+
+            auto frame = entry.get_frame().unwrap();
+            if (level > 1) {
+                kassert(is_direct_mapped(frame), "address_space::destroy: page table is not direct-mapped");
+                const auto *entries = reinterpret_cast<const page_table_entry *>(
+                    phys_to_virt(frame.start_address()).value());
+
+                for (std::size_t i = 0; i < page_entries_count; ++i) {
+                    _free_tables(entries[i], level - 1, al);
+                }
+            }
+            mapper::forget_page_table(frame);
+            al.deallocate_frame(frame);
+        }
+
+        static utils::optional<uint16_t> _allocate_pcid() noexcept
+        {
+            for (std::size_t word = 0; word < max_pcids / 64; ++word) {
+                /** PCID 0 is never handed out */
+                const auto free_bits = ~_used_pcids[word] & (word == 0 ? ~uint64_t(1) : ~uint64_t(0));
+
+                if (free_bits != 0) {
+                    const auto bit = static_cast<std::size_t>(__builtin_ctzll(free_bits));
+
+                    _used_pcids[word] |= uint64_t(1) << bit;
+                    return {static_cast<uint16_t>(word * 64 + bit)};
+                }
+            }
+            return std::nullopt;
+        }
+
+        static void _release_pcid(uint16_t pcid) noexcept
+        {
+            _used_pcids[pcid / 64] &= ~(uint64_t(1) << (pcid % 64));
+        }
+
+        physical_frame _p4;
+        uint16_t _pcid;
+        /** A new PCID may still tag entries of a destroyed address space */
+        bool _needs_flush{true};
+        std::size_t _seen_kernel_generation{0};
+
+        static inline bool _pcid_enabled{false};
+        static inline uint64_t _used_pcids[max_pcids / 64]{};
+    };
+}
+
+#endif /* !FOROS_MEMORY_ADDRESS_SPACE_HPP */
@@ -0,0 +1,255 @@
+/*
+** Created by doom on 18/10/26.
+*/
+
+#ifndef FOROS_MEMORY_ARENA_HPP
+#define FOROS_MEMORY_ARENA_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <core/compiler_hints.hpp>
+#include <core/panic.hpp>
+#include <memory/definitions.hpp>
+#include <memory/kernel_heap.hpp>
+
+namespace foros::memory
+{
+    /**
+     * An arena hands out memory by bumping a pointer in chunks taken from the kernel heap, and frees it all at
+     * once, when reset or destroyed.
+     *
+     * It suits bursts of short-lived allocations which die together, such as the temporary buffers of a system
+     * call: allocating costs a few instructions, and freeing the objects one by one costs nothing.
+     * Reset keeps the first chunk, so an arena reused for the same kind of work stops touching the heap.
+     */
+    class arena
+    {
+    public:
+        static constexpr const std::size_t default_chunk_size = 4 * page_size;
+
+        explicit arena(std::size_t chunk_size = default_chunk_size) noexcept : _chunk_size(chunk_size)
+        {
+        }
+
+        arena(const arena &) = delete;
+
+        arena &operator=(const arena &) = delete;
+
+        ~arena() noexcept
+        {
+            reset();
+            if (_chunks != nullptr) {
+                _release(_chunks);
+                _chunks = nullptr;
+            }
+        }
+
+        /**
+         * Allocate memory from the arena
+         *
+         * @param size          the size of the allocation
+         * @param align         the alignment of the allocation, a power of two
+         *
+         * @return              on success, the allocated memory
+         *                      on failure, nullptr
+         */
+        void *allocate(std::size_t size, std::size_t align = alignof(std::max_align_t)) noexcept
+        {
+            auto addr = (_current + align - 1) & ~(align - 1);
+
+            if unlikely(_chunks == nullptr || addr + size > _end) {
+                if (!_add_chunk(size + align)) {
+                    return nullptr;
+                }
+                addr = (_current + align - 1) & ~(align - 1);
+            }
+            _current = addr + size;
+            return reinterpret_cast<void *>(addr);
+        }
+
+        /**
+         * Give back an allocation. Only the latest one is actually reclaimed, which undoes a temporary allocation
+         * made last. A growing container gets nothing back, as it allocates its new buffer before freeing the old
+         * one, so the old buffers stay until the arena is reset.
+         *
+         * @param ptr           the allocated memory
+         * @param size          the size of the allocation
+         */
+        void deallocate(void *ptr, std::size_t size) noexcept
+        {
+            if (reinterpret_cast<uintptr_t>(ptr) + size == _current) {
+                _current = reinterpret_cast<uintptr_t>(ptr);
+            }
+        }
+
+        /**
+         * Free everything allocated from the arena, keeping its first chunk for the next allocations
+         */
+        void reset() noexcept
+        {
+            if (_chunks == nullptr) {
+                return;
+            }
+            while (_chunks->next != nullptr) {
+                auto *next = _chunks->next;
+
+                _release(_chunks);
+                _chunks = next;
+            }
+            _current = _chunks->start();
+            _end = _chunks->end();
+        }
+
+        /** Get the number of chunks taken from the heap */
+        std::size_t chunks_count() const noexcept
+        {
+            std::size_t count = 0;
+
+            for (auto *c = _chunks; c != nullptr; c = c->next) {
+                ++count;
+            }
+            return count;
+        }
+
+    private:
+        /** Header at the start of each chunk, the latest chunk being the head of the list */
+        struct chunk
+        {
+            chunk *next;
+            std::size_t size;
+
+            uintptr_t start() const noexcept
+            {
+                return reinterpret_cast<uintptr_t>(this) + sizeof(chunk);
+            }
+
+            uintptr_t end() const noexcept
+            {
+                return reinterpret_cast<uintptr_t>(this) + size;
+            }
+        };
+
+        bool _add_chunk(std::size_t min_size) noexcept
+        {
+            const auto size = std::max(_chunk_size, min_size + sizeof(chunk));
+            auto *c = static_cast<chunk *>(kernel_heap::instance().allocate(size, alignof(chunk)));
+
+            if (c == nullptr) {
+                return false;
+            }
+            c->next = _chunks;
+            c->size = size;
+            _chunks = c;
+            _current = c->start();
+            _end = c->end();
+            return true;
+        }
+
+        static void _release(chunk *c) noexcept
+        {
+            kernel_heap::instance().deallocate(c, c->size, alignof(chunk));
+        }
+
+        std::size_t _chunk_size;
+        chunk *_chunks{nullptr};
+        uintptr_t _current{0};
+        uintptr_t _end{0};
+    };
+
+    /** Allocator adapter allowing standard containers to live in an arena */
+    template <typename T>
+    class arena_allocator
+    {
+    public:
+        using value_type = T;
+        using pointer = T *;
+        using const_pointer = const T *;
+        using reference = T &;
+        using const_reference = const T &;
+        using size_type = std::size_t;
+        using difference_type = std::ptrdiff_t;
+        using propagate_on_container_copy_assignment = std::true_type;
+        using propagate_on_container_move_assignment = std::true_type;
+        using propagate_on_container_swap = std::true_type;
+
+        template <class U>
+        struct rebind
+        {
+            using other = arena_allocator<U>;
+        };
+
+        using is_always_equal = std::false_type;
+
+        explicit arena_allocator(arena &a) noexcept : _arena(&a)
+        {
+        }
+
+        template <typename U>
+        arena_allocator(const arena_allocator<U> &other) noexcept : _arena(&other.source())
+        {
+        }
+
+        T *allocate(std::size_t n)
+        {
+            return reinterpret_cast<T *>(_arena->allocate(sizeof(T) * n, alignof(T)));
+        }
+
+        T *allocate(std::size_t n, [[maybe_unused]] const void *hint)
+        {
+            return allocate(n);
+        }
+
+        void deallocate(T *p, std::size_t n)
+        {
+            _arena->deallocate((void *)p, sizeof(T) * n);
+        }
+
+        template <typename U, typename ...Args>
+        void construct(U *p, Args &&...args)
+        {
+            ::new((void *)p) U(std::forward<Args>(args)...);
+        }
+
+        template <typename U>
+        void destroy(U *p)
+        {
+            p->~U();
+        }
+
+        pointer address(reference x) const
+        {
+            return std::addressof(x);
+        }
+
+        const_pointer address(const_reference x) const
+        {
+            return std::addressof(x);
+        }
+
+        arena &source() const noexcept
+        {
+            return *_arena;
+        }
+
+        template <typename U>
+        bool operator==(const arena_allocator<U> &other) const noexcept
+        {
+            return _arena == &other.source();
+        }
+
+        template <typename U>
+        bool operator!=(const arena_allocator<U> &other) const noexcept
+        {
+            return !(*this == other);
+        }
+
+    private:
+        arena *_arena;
+    };
+}
+
+#endif /* !FOROS_MEMORY_ARENA_HPP */
@@ -0,0 +1,244 @@
+/*
+** Created by doom on 18/10/26.
+*/
+
+#ifndef FOROS_MEMORY_BUDDY_ALLOCATOR_HPP
+#define FOROS_MEMORY_BUDDY_ALLOCATOR_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <utils/optional.hpp>
+#include <memory/definitions.hpp>
+#include <memory/physical_frame.hpp>
+
+namespace foros::memory
+{
+    /**
+     * The buddy allocator hands out physically contiguous blocks of 2^order frames, aligned on their size.
+     *
+     * It manages a pool of frames taken from the physical frame allocator at creation. Free blocks of each order
+     * are kept in a doubly linked list whose nodes are stored inside the free blocks themselves, and every frame
+     * has a tag telling whether it starts a free block (and of which order).
+     * When a block is freed, it is merged with its buddy (the other half of the block of the next order) for as
+     * long as that buddy is free as well, so large blocks become available again after heavy churn.
+     */
+    class buddy_frame_allocator
+    {
+    public:
+        /** Blocks go from a single frame (order 0) to 4MB (order 10), which covers 2MB pages */
+        static constexpr const std::size_t max_order = 10;
+        static constexpr const std::size_t orders_count = max_order + 1;
+
+        /** Order of the blocks backing a 2MB page */
+        static constexpr const std::size_t order_2m = 9;
+
+    private:
+        struct free_block
+        {
+            free_block *prev;
+            free_block *next;
+        };
+
+        static constexpr const uint8_t not_free = 0;
+
+        buddy_frame_allocator(physical_frame pool_start, std::size_t blocks_count, uint8_t *tags) noexcept :
+            _pool_start(pool_start), _frames_count(blocks_count << max_order), _tags(tags)
+        {
+            for (std::size_t i = 0; i < _frames_count; ++i) {
+                _tags[i] = not_free;
+            }
+            for (std::size_t i = 0; i < blocks_count; ++i) {
+                _push(i << max_order, max_order);
+            }
+        }
+
+    public:
+        /**
+         * Create a buddy allocator with a pool of blocks of the maximum order
+         *
+         * @param al            the physical frame allocator from which to take the pool
+         * @param blocks_count  the number of blocks of the maximum order in the pool
+         *
+         * @return              on success, an optional containing the allocator
+         *                      on failure, nullopt
+         */
+        static utils::optional<buddy_frame_allocator> create(physical_frame_allocator &al,
+                                                             std::size_t blocks_count) noexcept
+        {
+            const auto frames_count = blocks_count << max_order;
+            const auto tags_frames_count = (frames_count * sizeof(uint8_t) + page_size - 1) / page_size;
+
+            auto pool_opt = al.allocate_contiguous_frames(frames_count, 1 << max_order);
+            if (!pool_opt) {
+                return std::nullopt;
+            }
+
+            auto pool = pool_opt.unwrap();
+            auto tags_opt = al.allocate_contiguous_frames(tags_frames_count);
+            if (!tags_opt) {
+                al.deallocate_run({pool.value(), pool.value() + frames_count});
+                return std::nullopt;
+            }
+
+            auto tags = tags_opt.unwrap();
+
+            /** Free lists and tags are accessed through the identity mapping */
+            kassert((pool + frames_count).start_address().value() <= identity_mapped_size &&
+                    (tags + tags_frames_count).start_address().value() <= identity_mapped_size,
+                    "buddy_frame_allocator::create: pool is out of the identity-mapped memory");
+            return buddy_frame_allocator(pool, blocks_count,
+                                         reinterpret_cast<uint8_t *>(tags.start_address().value()));
+        }
+
+        /**
+         * Allocate a block of contiguous frames
+         *
+         * @param order         the order of the block (the block will contain 2^order frames)
+         *
+         * @return              on success, an optional containing the first frame of the block
+         *                      on failure, nullopt
+         */
+        utils::optional<physical_frame> allocate_frames(std::size_t order) noexcept
+        {
+            kassert(order <= max_order, "buddy_frame_allocator::allocate_frames: invalid order");
+            auto current_order = order;
+
+            while (current_order <= max_order && _free_lists[current_order] == nullptr) {
+                ++current_order;
+            }
+            if (current_order > max_order) {
+                return std::nullopt;
+            }
+
+            const auto index = _index_for(_free_lists[current_order]);
+            _remove(index, current_order);
+
+            /** Split the block until it has the requested order, giving back the upper halves */
+            while (current_order > order) {
+                --current_order;
+                _push(index + (std::size_t(1) << current_order), current_order);
+            }
+            return {_pool_start + index};
+        }
+
+        /**
+         * Free a block of contiguous frames, merging it with its buddies when possible
+         *
+         * @param frame         the first frame of the block
+         * @param order         the order with which the block was allocated
+         */
+        void free_frames(physical_frame frame, std::size_t order) noexcept
+        {
+            kassert(owns(frame) && order <= max_order, "buddy_frame_allocator::free_frames: invalid block");
+            auto index = frame.value() - _pool_start.value();
+
+            kassert((index & ((std::size_t(1) << order) - 1)) == 0,
+                    "buddy_frame_allocator::free_frames: misaligned block");
+            kassert(_tags[index] == not_free, "buddy_frame_allocator::free_frames: block is already free");
+            while (order < max_order) {
+                const auto buddy = index ^ (std::size_t(1) << order);
+
+                if (_tags[buddy] != _tag_for(order)) {
+                    break;
+                }
+                _remove(buddy, order);
+                index = std::min(index, buddy);
+                ++order;
+            }
+            _push(index, order);
+        }
+
+        /**
+         * Check whether a frame belongs to the pool of this allocator
+         *
+         * @param frame         the frame
+         *
+         * @return              if the frame is in the pool, true
+         *                      otherwise, false
+         */
+        bool owns(physical_frame frame) const noexcept
+        {
+            return _pool_start <= frame && frame.value() < _pool_start.value() + _frames_count;
+        }
+
+        std::size_t free_blocks_count(std::size_t order) const noexcept
+        {
+            return _free_counts[order];
+        }
+
+        std::size_t free_frames_count() const noexcept
+        {
+            std::size_t total = 0;
+
+            for (std::size_t order = 0; order < orders_count; ++order) {
+                total += _free_counts[order] << order;
+            }
+            return total;
+        }
+
+        std::size_t frames_count() const noexcept
+        {
+            return _frames_count;
+        }
+
+        /** Get the frames making up the pool of this allocator */
+        frame_range pool() const noexcept
+        {
+            return {_pool_start.value(), _pool_start.value() + _frames_count};
+        }
+
+    private:
+        static constexpr uint8_t _tag_for(std::size_t order) noexcept
+        {
+            return static_cast<uint8_t>(order + 1);
+        }
+
+        free_block *_block_at(std::size_t index) const noexcept
+        {
+            return reinterpret_cast<free_block *>((_pool_start + index).start_address().value());
+        }
+
+        std::size_t _index_for(const free_block *block) const noexcept
+        {
+            return physical_frame::for_address(physical_address(block)).value() - _pool_start.value();
+        }
+
+        void _push(std::size_t index, std::size_t order) noexcept
+        {
+            auto *block = _block_at(index);
+
+            block->prev = nullptr;
+            block->next = _free_lists[order];
+            if (block->next) {
+                block->next->prev = block;
+            }
+            _free_lists[order] = block;
+            _tags[index] = _tag_for(order);
+            ++_free_counts[order];
+        }
+
+        void _remove(std::size_t index, std::size_t order) noexcept
+        {
+            auto *block = _block_at(index);
+
+            if (block->prev) {
+                block->prev->next = block->next;
+            } else {
+                _free_lists[order] = block->next;
+            }
+            if (block->next) {
+                block->next->prev = block->prev;
+            }
+            _tags[index] = not_free;
+            --_free_counts[order];
+        }
+
+        physical_frame _pool_start;
+        std::size_t _frames_count;
+        uint8_t *_tags;
+        free_block *_free_lists[orders_count]{};
+        std::size_t _free_counts[orders_count]{};
+    };
+}
+
+#endif /* !FOROS_MEMORY_BUDDY_ALLOCATOR_HPP */
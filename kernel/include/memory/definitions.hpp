@@ -14,6 +14,30 @@ namespace foros::memory
     static constexpr const std::size_t page_size = 4096;
     static constexpr const std::size_t page_entries_count = 512;
 
+    /** Sizes of the pages mapped directly by P2 and P3 entries */
+    static constexpr const std::size_t page_size_2m = page_size * page_entries_count;
+    static constexpr const std::size_t page_size_1g = page_size_2m * page_entries_count;
+
+    /** The boot code identity-maps the first GiB of physical memory using 2MB pages */
+    static constexpr const std::size_t identity_mapped_size = page_size_1g;
+
+    /** Index of the P4 entry pointing to the P4 table itself */
+    static constexpr const std::size_t recursive_p4_index = 511;
+
+    /**
+     * Check whether a P4 entry belongs to the kernel, in which case it is shared by every address space.
+     * The kernel uses the first 512GB (identity map and kernel heap) and the higher half.
+     *
+     * @param index         the index of the P4 entry
+     *
+     * @return              if the entry is a kernel one, true
+     *                      otherwise, false
+     */
+    constexpr bool is_kernel_p4_index(std::size_t index) noexcept
+    {
+        return index == 0 || (index >= page_entries_count / 2 && index != recursive_p4_index);
+    }
+
     struct physical_address :
         public st::type_base<uintptr_t>,
         public st::traits::arithmetic<physical_address>,
@@ -39,6 +63,93 @@ namespace foros::memory
 
     static_assert(sizeof(physical_address) == sizeof(uintptr_t));
     static_assert(sizeof(virtual_address) == sizeof(uintptr_t));
+
+    /** Start of the linear mapping of the physical memory, at the beginning of the higher half (P4 entry 256) */
+    static constexpr const uintptr_t direct_map_base = 0xffff800000000000;
+
+    /** The direct map may use up to 64TB of the higher half (P4 entries 256 to 383) */
+    static constexpr const std::size_t direct_map_max_size = page_size_1g * page_entries_count * 128;
+
+    /** Area in which kernel virtual ranges are handed out dynamically (P4 entries 384 to 447) */
+    static constexpr const uintptr_t kernel_ranges_start = 0xffffc00000000000;
+    static constexpr const uintptr_t kernel_ranges_end = 0xffffe00000000000;
+
+    namespace details
+    {
+        /**
+         * Until the direct map is built, physical memory is only reachable through the identity mapping of the
+         * boot code, so the offset starts at 0.
+         */
+        inline uintptr_t direct_map_offset = 0;
+
+        /** Range of physical addresses reachable through phys_to_virt(), from start (inclusive) to end (exclusive) */
+        struct direct_mapped_range
+        {
+            uintptr_t start;
+            uintptr_t end;
+        };
+
+        static constexpr const std::size_t max_direct_mapped_ranges = 32;
+
+        /** Sorted ranges reachable through phys_to_virt(): the holes between usable regions are not mapped */
+        inline direct_mapped_range direct_mapped_ranges[max_direct_mapped_ranges] = {{0, identity_mapped_size}};
+        inline std::size_t direct_mapped_ranges_count = 1;
+    }
+
+    /**
+     * Get the address through which the kernel can access a physical address
+     *
+     * @param addr          the physical address, which has to be direct-mapped
+     *
+     * @return              the virtual address
+     */
+    inline virtual_address phys_to_virt(physical_address addr) noexcept
+    {
+        return virtual_address(addr.value() + details::direct_map_offset);
+    }
+
+    /**
+     * Get the physical address behind an address of the direct map. Other virtual addresses have to go through
+     * the page tables instead (see mapper::get_frame_for_address).
+     *
+     * @param addr          the virtual address, which has to belong to the direct map
+     *
+     * @return              the physical address
+     */
+    inline physical_address virt_to_phys(virtual_address addr) noexcept
+    {
+        return physical_address(addr.value() - details::direct_map_offset);
+    }
+
+    /**
+     * Check whether a range of physical memory can be accessed through phys_to_virt()
+     *
+     * @param addr          the start of the range
+     * @param size          the size of the range, in bytes
+     *
+     * @return              if the range is direct-mapped, true
+     *                      otherwise, false
+     */
+    inline bool is_direct_mapped(physical_address addr, std::size_t size = 1) noexcept
+    {
+        const auto first = addr.value();
+        const auto last = first + (size == 0 ? 0 : size - 1);
+
+        if (last < first) {
+            return false;
+        }
+        for (std::size_t i = 0; i < details::direct_mapped_ranges_count; ++i) {
+            const auto &range = details::direct_mapped_ranges[i];
+
+            if (first < range.start) {
+                break;
+            }
+            if (last < range.end) {
+                return true;
+            }
+        }
+        return false;
+    }
 }
 
 #endif /* !FOROS_MEMORY_DEFINITIONS_HPP */
@@ -0,0 +1,170 @@
+/*
+** Created by doom on 18/10/26.
+*/
+
+#ifndef FOROS_MEMORY_DEMAND_PAGING_HPP
+#define FOROS_MEMORY_DEMAND_PAGING_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <core/panic.hpp>
+#include <utils/singleton.hpp>
+#include <memory/definitions.hpp>
+#include <memory/paging.hpp>
+#include <memory/tlb.hpp>
+#include <memory/zeroed_frame_pool.hpp>
+
+namespace foros::memory
+{
+    /**
+     * Registry of the virtual regions backed by physical memory on demand.
+     *
+     * Registering a region only reserves its virtual addresses. The first access to each of its pages triggers a
+     * page fault, which maps a zeroed frame to the page and resumes the faulting code. Large ranges can thus be
+     * reserved at boot while only the pages that are actually touched consume physical memory.
+     */
+    class demand_paged_regions : public utils::singleton<demand_paged_regions>
+    {
+    public:
+        static constexpr const std::size_t max_regions = 16;
+
+        struct region
+        {
+            std::size_t first_page;
+            std::size_t end_page;
+            /** The raw flags with which its pages are mapped */
+            uint64_t entry_flags;
+
+            bool contains(std::size_t page_number) const noexcept
+            {
+                return first_page <= page_number && page_number < end_page;
+            }
+        };
+
+        /**
+         * Register a region to be backed on demand.
+         * A region must not be touched from interrupt handlers: its faults map pages and allocate page tables,
+         * which would re-enter the mapper or the frame allocators if the interrupted code was updating them.
+         *
+         * @param start         the start address of the region, aligned on a page
+         * @param size          the size of the region, in bytes
+         * @param entry_flags   the flags with which to map the pages of the region
+         */
+        void add(virtual_address start, std::size_t size, page_table_entry::flags entry_flags) noexcept
+        {
+            kassert(start.value() % page_size == 0 && size > 0, "demand_paged_regions::add: invalid region");
+            kassert(_count < max_regions, "demand_paged_regions::add: too many regions");
+            const auto first_page = page::for_address(start).value();
+            const auto end_page = first_page + (size + page_size - 1) / page_size;
+            const region new_region{first_page, end_page, entry_flags.value()};
+            auto it = std::upper_bound(_regions, _regions + _count, new_region.first_page,
+                                       [](std::size_t page_number, const region &r) {
+                                           return page_number < r.first_page;
+                                       });
+
+            kassert((it == _regions + _count || new_region.end_page <= it->first_page) &&
+                    (it == _regions || (it - 1)->end_page <= new_region.first_page),
+                    "demand_paged_regions::add: region overlaps another one");
+            std::move_backward(it, _regions + _count, _regions + _count + 1);
+            *it = new_region;
+            ++_count;
+        }
+
+        /**
+         * Unregister a region, unmapping the pages of it which were backed
+         *
+         * @param start         the start address of the region, as given to add()
+         * @param al            the physical allocator to which the frames are given back
+         */
+        template <typename FrameAllocator>
+        void remove(virtual_address start, FrameAllocator &al) noexcept
+        {
+            const auto index = _index_of(page::for_address(start).value());
+
+            kassert(index < _count && _regions[index].first_page == page::for_address(start).value(),
+                    "demand_paged_regions::remove: no region starts at this address");
+
+            const auto r = _regions[index];
+            tlb_flush_batch batch;
+
+            for (auto page_number = r.first_page; page_number < r.end_page; ++page_number) {
+                if (mapper::get_frame_for_page(page(page_number))) {
+                    mapper::unmap(page(page_number), al, batch);
+                }
+            }
+            std::move(_regions + index + 1, _regions + _count, _regions + index);
+            --_count;
+        }
+
+        /**
+         * Back the page containing an address which caused a page fault, if it belongs to a registered region
+         *
+         * @param addr          the faulting address
+         * @param al            the physical allocator from which to take the frame
+         *
+         * @return              if the page was mapped and the faulting code can be resumed, true
+         *                      otherwise, false
+         */
+        template <typename FrameAllocator>
+        bool handle_fault(virtual_address addr, FrameAllocator &al) noexcept
+        {
+            const auto p = page(addr.value() / page_size);
+            const auto index = _index_of(p.value());
+
+            if (index == _count || mapper::get_frame_for_page(p)) {
+                return false;
+            }
+
+            utils::optional<physical_frame> frame_opt;
+            if constexpr (details::provides_zeroed_frames<FrameAllocator>::value) {
+                frame_opt = al.allocate_zeroed_frame();
+            } else {
+                frame_opt = al.allocate_frame();
+                if (frame_opt) {
+                    zero_frame(frame_opt.unwrap());
+                }
+            }
+            if (!frame_opt) {
+                return false;
+            }
+            const auto entry_flags = page_table_entry::flags(_regions[index].entry_flags);
+
+            mapper::map_page_to_frame(frame_opt.unwrap(), p, entry_flags, al);
+            ++_faults_handled;
+            return true;
+        }
+
+        std::size_t size() const noexcept
+        {
+            return _count;
+        }
+
+        /** Get the number of pages backed on demand so far */
+        std::size_t faults_handled() const noexcept
+        {
+            return _faults_handled;
+        }
+
+    private:
+        /** Find the region containing a page, or size() if there is none */
+        std::size_t _index_of(std::size_t page_number) const noexcept
+        {
+            auto it = std::upper_bound(_regions, _regions + _count, page_number,
+                                       [](std::size_t n, const region &r) {
+                                           return n < r.end_page;
+                                       });
+
+            if (it != _regions + _count && it->contains(page_number)) {
+                return static_cast<std::size_t>(it - _regions);
+            }
+            return _count;
+        }
+
+        region _regions[max_regions];
+        std::size_t _count{0};
+        std::size_t _faults_handled{0};
+    };
+}
+
+#endif /* !FOROS_MEMORY_DEMAND_PAGING_HPP */
@@ -0,0 +1,71 @@
+/*
+** Created by doom on 18/10/26.
+*/
+
+#ifndef FOROS_MEMORY_DIRECT_MAP_HPP
+#define FOROS_MEMORY_DIRECT_MAP_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <core/cpu.hpp>
+#include <core/panic.hpp>
+#include <memory/definitions.hpp>
+#include <memory/physical_regions.hpp>
+#include <memory/paging.hpp>
+
+namespace foros::memory
+{
+    /**
+     * Map every usable region of physical memory at direct_map_base + its physical address, then make
+     * phys_to_virt() go through this mapping instead of the identity mapping of the boot code.
+     * Only the regions are mapped, rounded to 2MB pages, and is_direct_mapped() only accepts these ranges.
+     *
+     * The mapping only uses huge pages: 1GB pages for the parts of a region spanning whole aligned gigabytes, when
+     * the CPU supports them, and 2MB pages for the rest. Its pages are global, so they are never flushed when
+     * switching address spaces.
+     *
+     * @param regions       the usable regions of physical memory
+     * @param al            the physical allocator used to allocate page tables
+     */
+    template <typename FrameAllocator>
+    inline void build_direct_map(const physical_region_table &regions, FrameAllocator &al) noexcept
+    {
+        constexpr auto frames_2m = frames_count_for(huge_page_size::size_2m);
+        constexpr auto frames_1g = frames_count_for(huge_page_size::size_1g);
+        const auto entry_flags = page_table_entry::flags::writable | page_table_entry::flags::global;
+        const auto first_page = direct_map_base / page_size;
+        const bool use_1g_pages = cpu_supports_1g_pages();
+        std::size_t mapped_end = 0;
+        std::size_t ranges_count = 0;
+        details::direct_mapped_range ranges[details::max_direct_mapped_ranges];
+
+        kassert(regions.end_frame() * page_size <= direct_map_max_size, "build_direct_map: too much physical memory");
+        for (const auto &region : regions) {
+            /** Neighbouring regions may share a 2MB page, which is then only mapped once */
+            auto frame = std::max(region.start / frames_2m * frames_2m, mapped_end);
+            const auto end = (region.end + frames_2m - 1) / frames_2m * frames_2m;
+
+            while (frame < end) {
+                const auto size = use_1g_pages && frame % frames_1g == 0 && frame + frames_1g <= region.end ?
+                                  huge_page_size::size_1g : huge_page_size::size_2m;
+
+                mapper::map_huge_page_to_frame(physical_frame(frame), page(first_page + frame), size, entry_flags, al);
+                frame += frames_count_for(size);
+            }
+            /** Regions sharing a 2MB page end up in the same range */
+            const auto range_start = region.start / frames_2m * frames_2m * page_size;
+            if (ranges_count > 0 && ranges[ranges_count - 1].end >= range_start) {
+                ranges[ranges_count - 1].end = std::max(ranges[ranges_count - 1].end, end * page_size);
+            } else {
+                kassert(ranges_count < details::max_direct_mapped_ranges, "build_direct_map: too many ranges");
+                ranges[ranges_count++] = {range_start, end * page_size};
+            }
+            mapped_end = std::max(mapped_end, end);
+        }
+        details::direct_map_offset = direct_map_base;
+        std::copy(ranges, ranges + ranges_count, details::direct_mapped_ranges);
+        details::direct_mapped_ranges_count = ranges_count;
+    }
+}
+
+#endif /* !FOROS_MEMORY_DIRECT_MAP_HPP */
@@ -0,0 +1,150 @@
+/*
+** Created by doom on 18/10/26.
+*/
+
+#ifndef FOROS_MEMORY_FRAME_CACHE_HPP
+#define FOROS_MEMORY_FRAME_CACHE_HPP
+
+#include <cstddef>
+#include <core/cpu.hpp>
+#include <core/compiler_hints.hpp>
+#include <interrupts/maskable_interrupts.hpp>
+#include <utils/optional.hpp>
+#include <memory/physical_frame.hpp>
+
+namespace foros::memory
+{
+    /**
+     * Per-CPU caches of free frames, in front of the physical frame allocator.
+     *
+     * Each CPU owns a magazine of free frames from which single frames are allocated and to which freed frames
+     * are returned. The global allocator is only used to refill an empty magazine or to drain a full one, half a
+     * magazine at a time, so most allocations and frees only touch the cache lines of the current CPU.
+     * Magazines are updated with maskable interrupts ignored, since interrupt handlers (the page fault handler
+     * among them) allocate frames on the same CPU.
+     */
+    class per_cpu_frame_cache
+    {
+    public:
+        static constexpr const std::size_t magazine_capacity = 64;
+        static constexpr const std::size_t batch_size = magazine_capacity / 2;
+
+        struct statistics
+        {
+            /** Allocations served from the magazine */
+            std::size_t allocation_hits;
+            /** Allocations that had to refill the magazine from the global allocator */
+            std::size_t allocation_misses;
+            /** Frees stored in the magazine */
+            std::size_t free_hits;
+            /** Frees that had to drain the magazine to the global allocator */
+            std::size_t free_misses;
+        };
+
+        explicit per_cpu_frame_cache(physical_frame_allocator &global) noexcept : _global(&global)
+        {
+        }
+
+        utils::optional<physical_frame> allocate_frame() noexcept
+        {
+            maskable_interrupts_guard guard;
+            auto &mag = _magazines[current_cpu_index()];
+
+            if likely(mag.count > 0) {
+                ++mag.stats.allocation_hits;
+            } else {
+                ++mag.stats.allocation_misses;
+                _refill(mag);
+                if (mag.count == 0) {
+                    return std::nullopt;
+                }
+            }
+            return {mag.frames[--mag.count]};
+        }
+
+        void deallocate_frame(physical_frame frame) noexcept
+        {
+            maskable_interrupts_guard guard;
+            auto &mag = _magazines[current_cpu_index()];
+
+            if unlikely(mag.count == magazine_capacity) {
+                ++mag.stats.free_misses;
+                _drain(mag, batch_size);
+            } else {
+                ++mag.stats.free_hits;
+            }
+            mag.frames[mag.count++] = frame;
+        }
+
+        /**
+         * Give all the frames cached by every CPU back to the global allocator
+         */
+        void flush() noexcept
+        {
+            maskable_interrupts_guard guard;
+
+            for (auto &mag : _magazines) {
+                _drain(mag, mag.count);
+            }
+        }
+
+        /**
+         * Get the hit and miss counters, summed over all CPUs
+         *
+         * @return              the statistics
+         */
+        statistics stats() const noexcept
+        {
+            statistics total{};
+
+            for (const auto &mag : _magazines) {
+                total.allocation_hits += mag.stats.allocation_hits;
+                total.allocation_misses += mag.stats.allocation_misses;
+                total.free_hits += mag.stats.free_hits;
+                total.free_misses += mag.stats.free_misses;
+            }
+            return total;
+        }
+
+        std::size_t cached_frames_count() const noexcept
+        {
+            std::size_t total = 0;
+
+            for (const auto &mag : _magazines) {
+                total += mag.count;
+            }
+            return total;
+        }
+
+        physical_frame_allocator &global_allocator() noexcept
+        {
+            return *_global;
+        }
+
+    private:
+        struct alignas(cache_line_size) magazine
+        {
+            physical_frame frames[magazine_capacity];
+            std::size_t count{0};
+            statistics stats{};
+        };
+
+        void _refill(magazine &mag) noexcept
+        {
+            mag.count += _global->allocate_frames(utils::span<physical_frame>(mag.frames + mag.count,
+                                                                              batch_size - mag.count));
+        }
+
+        void _drain(magazine &mag, std::size_t count) noexcept
+        {
+            while (count-- > 0) {
+                _global->deallocate_frame(mag.frames[--mag.count]);
+            }
+        }
+
+        physical_frame_allocator *_global;
+        magazine _magazines[max_cpus];
+    };
+}
+
+#endif /* !FOROS_MEMORY_FRAME_CACHE_HPP */
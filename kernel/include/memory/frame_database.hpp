@@ -0,0 +1,252 @@
+/*
+** Created by doom on 18/10/26.
+*/
+
+#ifndef FOROS_MEMORY_FRAME_DATABASE_HPP
+#define FOROS_MEMORY_FRAME_DATABASE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <core/cpu.hpp>
+#include <core/panic.hpp>
+#include <utils/optional.hpp>
+#include <memory/definitions.hpp>
+#include <memory/physical_regions.hpp>
+#include <memory/physical_frame.hpp>
+
+namespace foros::memory
+{
+    /** The subsystem a physical frame belongs to */
+    enum class frame_owner : uint8_t
+    {
+        /** The frame is free, or owned by someone who did not register it */
+        none = 0,
+        /** The frame is not usable memory, or is used by the firmware, the kernel image or the boot information */
+        reserved,
+        /** The frame holds allocator metadata, such as the frame bitmap or this database */
+        allocator,
+        page_table,
+        heap,
+        /** The frame belongs to the pool of the buddy allocator */
+        contiguous,
+    };
+
+    static constexpr const std::size_t frame_owners_count = static_cast<std::size_t>(frame_owner::contiguous) + 1;
+
+    enum class frame_flags : uint8_t
+    {
+        none = 0,
+        /** The frame must never be reclaimed */
+        pinned = 1,
+        /** The frame is known to be filled with zeros */
+        zeroed = 1 << 1,
+    };
+
+    /** Metadata of a physical frame */
+    struct frame_descriptor
+    {
+        /** Number of users of the frame (mappings, references held by the kernel, ...) */
+        uint32_t refcount;
+        frame_owner owner;
+        uint8_t flags;
+        uint16_t reserved;
+
+        bool has(frame_flags flag) const noexcept
+        {
+            return (flags & static_cast<uint8_t>(flag)) != 0;
+        }
+
+        void set(frame_flags flag) noexcept
+        {
+            flags |= static_cast<uint8_t>(flag);
+        }
+
+        void clear(frame_flags flag) noexcept
+        {
+            flags &= ~static_cast<uint8_t>(flag);
+        }
+    };
+
+    static_assert(sizeof(frame_descriptor) == 8 && cache_line_size % sizeof(frame_descriptor) == 0,
+                  "frame descriptors must not straddle cache lines");
+
+    /**
+     * The frame database holds one descriptor per physical frame, indexed by frame number.
+     *
+     * It covers every frame up to the end of the last usable region, so looking up a frame is a single array access.
+     * Frames outside of the usable regions are owned by frame_owner::reserved from the start. The database also
+     * keeps the number of frames held by each owner, so memory accounting never needs to walk the array.
+     */
+    class frame_database
+    {
+        frame_database(frame_descriptor *descriptors, std::size_t frames_count,
+                       const physical_region_table &regions) noexcept :
+            _descriptors(descriptors), _frames_count(frames_count)
+        {
+            std::size_t next = 0;
+
+            for (const auto &region : regions) {
+                _fill({next, region.start}, frame_owner::reserved);
+                _fill(region, frame_owner::none);
+                next = region.end;
+            }
+            _fill({next, _frames_count}, frame_owner::reserved);
+        }
+
+    public:
+        /**
+         * Create the frame database, taking its storage from the physical frame allocator
+         *
+         * @param al            the physical frame allocator
+         *
+         * @return              on success, an optional containing the database
+         *                      on failure, nullopt
+         */
+        static utils::optional<frame_database> create(physical_frame_allocator &al) noexcept
+        {
+            const auto frames_count = al.regions().end_frame();
+            const auto storage_frames_count = (frames_count * sizeof(frame_descriptor) + page_size - 1) / page_size;
+            auto storage_opt = al.allocate_contiguous_frames(storage_frames_count);
+
+            if (!storage_opt) {
+                return std::nullopt;
+            }
+
+            auto storage = storage_opt.unwrap();
+
+            kassert((storage + storage_frames_count).start_address().value() <= identity_mapped_size,
+                    "frame_database::create: storage is out of the identity-mapped memory");
+            frame_database db(reinterpret_cast<frame_descriptor *>(storage.start_address().value()),
+                              frames_count, al.regions());
+            db.assign({storage.value(), storage.value() + storage_frames_count}, frame_owner::allocator);
+            return {db};
+        }
+
+        bool contains(physical_frame frame) const noexcept
+        {
+            return frame.value() < _frames_count;
+        }
+
+        frame_descriptor &operator[](physical_frame frame) noexcept
+        {
+            kassert(contains(frame), "frame_database::operator[]: frame out of range");
+            return _descriptors[frame.value()];
+        }
+
+        const frame_descriptor &operator[](physical_frame frame) const noexcept
+        {
+            kassert(contains(frame), "frame_database::operator[]: frame out of range");
+            return _descriptors[frame.value()];
+        }
+
+        /**
+         * Give a range of frames to an owner, with a single reference each
+         *
+         * @param range         the frames
+         * @param owner         their new owner
+         */
+        void assign(frame_range range, frame_owner owner) noexcept
+        {
+            kassert(range.end <= _frames_count, "frame_database::assign: range out of bounds");
+            for (auto i = range.start; i < range.end; ++i) {
+                auto &desc = _descriptors[i];
+
+                --_owner_counts[_index_for(desc.owner)];
+                desc = {1, owner, static_cast<uint8_t>(frame_flags::none), 0};
+                ++_owner_counts[_index_for(owner)];
+            }
+        }
+
+        /**
+         * Take new references to a frame
+         *
+         * @param frame         the frame
+         * @param count         the number of references to take
+         *
+         * @return              the new reference count
+         */
+        std::size_t get(physical_frame frame, std::size_t count = 1) noexcept
+        {
+            auto &desc = (*this)[frame];
+
+            kassert(desc.owner != frame_owner::none, "frame_database::get: frame has no owner");
+            desc.refcount += count;
+            return desc.refcount;
+        }
+
+        /**
+         * Drop references to a frame. When the last one is dropped, the frame goes back to frame_owner::none,
+         * and the caller is responsible for freeing it.
+         *
+         * @param frame         the frame
+         * @param count         the number of references to drop
+         *
+         * @return              the new reference count
+         */
+        std::size_t put(physical_frame frame, std::size_t count = 1) noexcept
+        {
+            auto &desc = (*this)[frame];
+
+            kassert(desc.refcount >= count && count > 0, "frame_database::put: frame is not referenced");
+            kassert(!desc.has(frame_flags::pinned) || desc.refcount > count, "frame_database::put: frame is pinned");
+            desc.refcount -= count;
+            if (desc.refcount == 0) {
+                release(frame);
+            }
+            return desc.refcount;
+        }
+
+        /**
+         * Give a frame back to frame_owner::none, whatever its reference count
+         *
+         * @param frame         the frame
+         */
+        void release(physical_frame frame) noexcept
+        {
+            auto &desc = (*this)[frame];
+
+            --_owner_counts[_index_for(desc.owner)];
+            desc = {0, frame_owner::none, static_cast<uint8_t>(frame_flags::none), 0};
+            ++_owner_counts[_index_for(frame_owner::none)];
+        }
+
+        /**
+         * Get the number of frames held by an owner
+         *
+         * @param owner         the owner
+         *
+         * @return              the number of frames
+         */
+        std::size_t frames_count(frame_owner owner) const noexcept
+        {
+            return _owner_counts[_index_for(owner)];
+        }
+
+        std::size_t frames_count() const noexcept
+        {
+            return _frames_count;
+        }
+
+    private:
+        static constexpr std::size_t _index_for(frame_owner owner) noexcept
+        {
+            return static_cast<std::size_t>(owner);
+        }
+
+        void _fill(frame_range range, frame_owner owner) noexcept
+        {
+            for (auto i = range.start; i < range.end; ++i) {
+                _descriptors[i] = {0, owner, static_cast<uint8_t>(frame_flags::none), 0};
+            }
+            if (!range.empty()) {
+                _owner_counts[_index_for(owner)] += range.size();
+            }
+        }
+
+        frame_descriptor *_descriptors;
+        std::size_t _frames_count;
+        std::size_t _owner_counts[frame_owners_count]{};
+    };
+}
+
+#endif /* !FOROS_MEMORY_FRAME_DATABASE_HPP */
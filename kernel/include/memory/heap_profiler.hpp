@@ -0,0 +1,208 @@
+/*
+** Created by doom on 18/10/26.
+*/
+
+#ifndef FOROS_MEMORY_HEAP_PROFILER_HPP
+#define FOROS_MEMORY_HEAP_PROFILER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <core/compiler_hints.hpp>
+#include <memory/definitions.hpp>
+
+namespace foros::memory
+{
+    /**
+     * The heap profiler samples allocations of the kernel heap, and attributes the bytes they stand for to the
+     * code which made them.
+     *
+     * A sample is taken every time the allocated bytes go past a randomized threshold, about once per sampling
+     * interval, and weighs all the bytes allocated since the previous one. Between samples, an allocation only
+     * costs a subtraction. A free costs a lookup in a small table counting the samples of each page, and only
+     * searches the samples when its page holds one, so the profiler can be left on under load.
+     *
+     * Call sites are the return address of the allocation, followed by a short backtrace when the kernel is
+     * built with frame pointers (HEAP_PROFILER_BACKTRACE=yes). Their bytes are kept in fixed-size tables, and
+     * samples which do not fit are counted as dropped.
+     */
+    class heap_profiler
+    {
+    public:
+        /** Average number of bytes allocated between two samples */
+        static constexpr const std::size_t default_sampling_interval = 64 * 1024;
+
+        /** Number of return addresses kept per call site */
+        static constexpr const std::size_t max_frames = 4;
+
+        static constexpr const std::size_t max_sites = 256;
+
+        /** Number of sampled allocations which can be live at once, a power of two */
+        static constexpr const std::size_t max_samples = 1024;
+
+        /** Number of counters filtering the frees, a power of two */
+        static constexpr const std::size_t filter_pages = 1024;
+
+        static_assert((max_samples & (max_samples - 1)) == 0 && (filter_pages & (filter_pages - 1)) == 0 &&
+                      max_sites < UINT16_MAX && max_samples < UINT16_MAX,
+                      "heap profiler tables are misconfigured");
+
+        struct site
+        {
+            /** Return addresses of the allocation, from the innermost, unused ones being null */
+            void *frames[max_frames];
+            /** Estimated bytes allocated from this site and not freed yet */
+            std::size_t live_bytes;
+            std::size_t allocated_bytes;
+            std::size_t samples;
+        };
+
+        /**
+         * Start sampling allocations
+         *
+         * @param interval      the average number of bytes allocated between two samples
+         */
+        void enable(std::size_t interval = default_sampling_interval) noexcept
+        {
+            _interval = interval == 0 ? 1 : interval;
+            _enabled = true;
+            _arm();
+        }
+
+        /** Stop sampling allocations. The live samples are still forgotten as they are freed. */
+        void disable() noexcept
+        {
+            _enabled = false;
+            _bytes_until_sample = disabled_countdown;
+        }
+
+        bool enabled() const noexcept
+        {
+            return _enabled;
+        }
+
+        /** Forget every call site and sample */
+        void reset() noexcept;
+
+        /**
+         * Account an allocation, telling whether it has to be sampled
+         *
+         * @param size          the size of the allocation
+         *
+         * @return              true if the allocation has to be passed to record_allocation()
+         */
+        force_inline bool should_sample(std::size_t size) noexcept
+        {
+            _bytes_until_sample -= static_cast<std::ptrdiff_t>(size);
+            return unlikely(_bytes_until_sample < 0);
+        }
+
+        /**
+         * Record a sampled allocation
+         *
+         * @param ptr           the allocated memory
+         * @param return_addr   the return address of the allocation function
+         * @param frame         the frame of the allocation function, from which the backtrace is walked
+         */
+        void record_allocation(void *ptr, void *return_addr, void *frame) noexcept;
+
+        /**
+         * Forget an allocation if it was sampled
+         *
+         * @param ptr           the freed memory
+         */
+        force_inline void record_deallocation(void *ptr) noexcept
+        {
+            if unlikely(_page_samples[_filter_slot(ptr)] != 0) {
+                _forget(ptr);
+            }
+        }
+
+        /**
+         * Get the call site of a live sampled allocation
+         *
+         * @param ptr           the allocated memory
+         *
+         * @return              the site, or nullptr if the allocation was not sampled
+         */
+        const site *find_site(const void *ptr) const noexcept;
+
+        std::size_t sites_count() const noexcept
+        {
+            return _sites_count;
+        }
+
+        std::size_t live_samples() const noexcept
+        {
+            return _live_samples;
+        }
+
+        /** Get the number of samples lost because one of the tables was full */
+        std::size_t dropped_samples() const noexcept
+        {
+            return _dropped_samples;
+        }
+
+        /**
+         * Print the call sites holding the most live bytes on the console
+         *
+         * @param count         the maximum number of sites printed
+         */
+        void dump(std::size_t count = 16) const noexcept;
+
+    private:
+        static constexpr const std::ptrdiff_t disabled_countdown = PTRDIFF_MAX;
+
+        /** Callers' frames are above the current one, and never further than a kernel stack */
+        static constexpr const uintptr_t max_frame_distance = 64 * 1024;
+
+        /** Live sampled allocation, in an open addressing table where free slots have no pointer */
+        struct sample
+        {
+            const void *ptr;
+            std::size_t weight;
+            uint16_t site;
+        };
+
+        /** Draw the number of bytes until the next sample, uniformly around the interval */
+        void _arm() noexcept
+        {
+            _seed ^= _seed << 13;
+            _seed ^= _seed >> 7;
+            _seed ^= _seed << 17;
+            _armed_bytes = static_cast<std::ptrdiff_t>(_interval / 2 + _seed % _interval);
+            _bytes_until_sample = _armed_bytes;
+        }
+
+        void _capture(void *return_addr, void *frame, void *(&frames)[max_frames]) const noexcept;
+
+        uint16_t _site_for(void *const (&frames)[max_frames]) noexcept;
+
+        /** Get the counter of the samples in the page of a pointer, shared by the pages of the same residue */
+        static force_inline std::size_t _filter_slot(const void *ptr) noexcept
+        {
+            return (reinterpret_cast<uintptr_t>(ptr) / page_size) & (filter_pages - 1);
+        }
+
+        /** Get the slot where the probe sequence of a pointer starts */
+        static std::size_t _home_slot(const void *ptr) noexcept;
+
+        /** Get the slot holding a pointer, or the free slot ending its probe sequence */
+        std::size_t _sample_slot(const void *ptr) const noexcept;
+
+        void _forget(void *ptr) noexcept;
+
+        bool _enabled{false};
+        std::size_t _interval{default_sampling_interval};
+        std::ptrdiff_t _armed_bytes{0};
+        std::ptrdiff_t _bytes_until_sample{disabled_countdown};
+        uint64_t _seed{0x9e3779b97f4a7c15};
+        std::size_t _sites_count{0};
+        std::size_t _live_samples{0};
+        std::size_t _dropped_samples{0};
+        site _sites[max_sites]{};
+        sample _samples[max_samples]{};
+        uint16_t _page_samples[filter_pages]{};
+    };
+}
+
+#endif /* !FOROS_MEMORY_HEAP_PROFILER_HPP */
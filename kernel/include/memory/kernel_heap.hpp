@@ -10,26 +10,344 @@
 #include <utils/optional.hpp>
 #include <memory/definitions.hpp>
 #include <memory/physical_frame.hpp>
+#include <memory/buddy_allocator.hpp>
+#include <memory/frame_database.hpp>
+#include <memory/frame_cache.hpp>
+#include <memory/heap_profiler.hpp>
+#include <memory/zeroed_frame_pool.hpp>
+#include <memory/virtual_range_allocator.hpp>
+#include <memory/size_classes.hpp>
+#include <memory/slab.hpp>
 
 namespace foros::memory
 {
+    /**
+     * The kernel heap serves small allocations from slabs, one list of slabs with free objects per size class,
+     * so allocating and freeing them takes constant time. The pages of the slabs come from the heap area, and go
+     * back to it when a slab becomes empty while its class still has others. The slabs of the classes above a
+     * quarter of a page span a whole chunk, so that allocations up to two pages never touch the page tables.
+     * Larger allocations are made of whole pages, mapped in a range of kernel virtual addresses of their own.
+     *
+     * The heap area is a large range of virtual addresses, only backed by physical memory in chunks, as the
+     * slabs need pages. Chunks whose pages are all free again are unmapped, and their frames given back.
+     */
     class kernel_heap : public utils::singleton<kernel_heap>
     {
     public:
-        void initialize(const multiboot2::boot_information &boot_info,
-                        virtual_address start_address,
-                        virtual_address end_address) noexcept;
+        /** Size of the virtual range reserved for the heap area */
+        static constexpr const std::size_t area_size = 256 * 1024 * 1024;
+
+        /** The heap area is mapped and unmapped by chunks of this size */
+        static constexpr const std::size_t chunk_size = 64 * 1024;
+        static constexpr const std::size_t chunk_pages = chunk_size / page_size;
+        static constexpr const std::size_t max_chunks = area_size / chunk_size;
+
+        /** Number of chunks mapped at boot, the first ones of the area, which are never given back */
+        static constexpr const std::size_t initial_chunks = 2;
+
+        /** Objects up to this size are cut from single-page slabs, larger ones from slabs of a whole chunk */
+        static constexpr const std::size_t max_page_slab_size = page_size / 4;
+
+        /** The size histogram has a bucket for requests up to 16 bytes, then one per power of two */
+        static constexpr const std::size_t size_histogram_buckets = 16;
+
+        struct statistics
+        {
+            std::size_t allocations;
+            std::size_t deallocations;
+            std::size_t failed_allocations;
+            /** Bytes requested by the live allocations */
+            std::size_t live_bytes;
+            std::size_t peak_live_bytes;
+            /** Bytes lost by the live allocations to the rounding of their size up to a size class or to pages */
+            std::size_t rounding_bytes;
+            /** Part of the rounding caused by alignment requests, which moved allocations up to larger classes */
+            std::size_t alignment_bytes;
+            std::size_t live_large_allocations;
+            std::size_t live_large_pages;
+            std::size_t class_allocations[size_classes_count];
+            std::size_t class_live_objects[size_classes_count];
+            /** Number of requests of each size, sizes in bucket i being up to 2^(i + 4) bytes */
+            std::size_t size_histogram[size_histogram_buckets];
+        };
+
+        void initialize(const multiboot2::boot_information &boot_info) noexcept;
 
         void *allocate(size_t size, size_t align = alignof(std::max_align_t)) noexcept;
 
+        /**
+         * Allocate memory on behalf of the caller of an allocation function wrapping the heap, such as operator new,
+         * so that the profiler attributes the allocation to that caller
+         *
+         * @param size          the size of the allocation
+         * @param align         the alignment of the allocation
+         * @param return_addr   the return address of the allocation function
+         * @param frame         the frame of the allocation function
+         *
+         * @return              on success, the allocated memory
+         *                      on failure, nullptr
+         */
+        void *allocate(size_t size, size_t align, void *return_addr, void *frame) noexcept;
+
         void deallocate(void *ptr, std::size_t size, std::size_t align = alignof(std::max_align_t)) noexcept;
 
+        /**
+         * Free an allocation whose size is not known anymore, such as an array freed by operator delete[].
+         * Large allocations know their requested size. Small ones are counted at the size of their object, so they
+         * have to be allocated with their rounded_size() for the statistics to stay exact.
+         *
+         * @param ptr           the allocated memory
+         */
+        void deallocate(void *ptr) noexcept;
+
+        /**
+         * Get the number of bytes actually handed out for an allocation
+         *
+         * @param size          the size of the allocation
+         * @param align         the alignment of the allocation
+         *
+         * @return              the size of the object of its size class, or its size rounded up to whole pages
+         */
+        static std::size_t rounded_size(std::size_t size, std::size_t align = alignof(std::max_align_t)) noexcept
+        {
+            return _held_bytes(size, size_class_for(size, align));
+        }
+
+        /**
+         * Get the number of bytes handed out for a live allocation, when its size is not known anymore.
+         * Small allocations read it from their slab, large ones from their record.
+         *
+         * @param ptr           the allocated memory
+         *
+         * @return              the rounded size of the allocation
+         */
+        std::size_t allocation_size(const void *ptr) const noexcept;
+
+        /** Get the physical frame allocator shared by the kernel */
+        physical_frame_allocator &frame_allocator() noexcept
+        {
+            return *_frame_allocator;
+        }
+
+        /** Get the per-CPU frame cache, which should be preferred for single frame allocations */
+        per_cpu_frame_cache &frame_cache() noexcept
+        {
+            return *_frame_cache;
+        }
+
+        /** Get the descriptors of every physical frame */
+        frame_database &frames() noexcept
+        {
+            return *_frame_database;
+        }
+
+        /** Get the allocator used for physically contiguous blocks of frames */
+        buddy_frame_allocator &contiguous_frame_allocator() noexcept
+        {
+            return *_buddy_allocator;
+        }
+
+        /** Get the pool of pre-zeroed frames, refilled while the CPU is idle */
+        zeroed_frame_pool &zeroed_frames() noexcept
+        {
+            return *_zeroed_frames;
+        }
+
+        /** Get the allocator of kernel virtual ranges, for large buffers, device windows and stacks */
+        virtual_range_allocator &virtual_ranges() noexcept
+        {
+            return *_virtual_ranges;
+        }
+
+        /**
+         * Take a whole page of the heap area, for allocators building on top of the heap such as kmem_cache
+         *
+         * @return              on success, the start of the page
+         *                      on failure, nullptr
+         */
+        void *allocate_page() noexcept;
+
+        /**
+         * Give back a page taken with allocate_page()
+         *
+         * @param page          the start of the page
+         */
+        void free_page(void *page) noexcept;
+
+        /** Get the number of chunks of the heap area currently backed by physical memory */
+        std::size_t mapped_chunks_count() const noexcept
+        {
+            return _mapped_chunks;
+        }
+
+        const statistics &stats() const noexcept
+        {
+            return _stats;
+        }
+
+        /** Get the number of pages of the heap area used by slabs */
+        std::size_t used_pages_count() const noexcept
+        {
+            return _used_pages;
+        }
+
+        /**
+         * Get the share of the memory held by the heap which does not hold requested bytes: rounding waste, free
+         * objects of the slabs and free pages of the mapped chunks
+         *
+         * @return              the fragmentation, in percent
+         */
+        std::size_t fragmentation_percent() const noexcept
+        {
+            const auto held = _mapped_chunks * chunk_size + _stats.live_large_pages * page_size;
+
+            return held == 0 ? 0 : (held - _stats.live_bytes) * 100 / held;
+        }
+
+        /** Print the statistics of the heap on the console */
+        void dump_statistics() const noexcept;
+
+        /** Get the sampling profiler of the allocations, disabled until enabled through it */
+        heap_profiler &profiler() noexcept
+        {
+            return _profiler;
+        }
+
     private:
+        void *_allocate_small(std::size_t class_index) noexcept;
+
+        /** Free a small allocation, returning its size class */
+        std::size_t _deallocate_small(void *ptr) noexcept;
+
+        void _record_allocation(std::size_t size, std::size_t align, std::size_t class_index) noexcept;
+
+        void _record_deallocation(std::size_t size, std::size_t alignment_bytes, std::size_t class_index) noexcept;
+
+        /** Get the bytes actually held by an allocation, and the part of them spent on its alignment */
+        static std::size_t _held_bytes(std::size_t size, std::size_t class_index) noexcept
+        {
+            return class_index < size_classes_count ? size_classes[class_index] :
+                   (size + page_size - 1) / page_size * page_size;
+        }
+
+        static std::size_t _alignment_bytes(std::size_t size, std::size_t align, std::size_t class_index) noexcept;
+
+        /**
+         * Record of a live large allocation, kept in a slab object instead of a header, so that large allocations
+         * stay aligned on pages and their size is known when they are freed
+         */
+        struct large_allocation
+        {
+            large_allocation *next;
+            uintptr_t start;
+            /** The requested size */
+            std::size_t size;
+        };
+
+        static constexpr const std::size_t large_allocation_buckets = 256;
+
+        static constexpr const std::size_t large_allocation_class =
+            size_class_for(sizeof(large_allocation), alignof(large_allocation));
+
+        void *_allocate_large(std::size_t size, std::size_t align) noexcept;
+
+        /** Free a large allocation, returning its requested size */
+        std::size_t _deallocate_large(void *ptr) noexcept;
+
+        static std::size_t _large_allocation_bucket(uintptr_t start) noexcept
+        {
+            return start / page_size % large_allocation_buckets;
+        }
+
+        /** Get the link pointing to the record of a large allocation, which is null if there is no such record */
+        large_allocation **_large_allocation_link(uintptr_t start) noexcept
+        {
+            auto **link = &_large_allocations[_large_allocation_bucket(start)];
+
+            while (*link != nullptr && (*link)->start != start) {
+                link = &(*link)->next;
+            }
+            return link;
+        }
+
+        const large_allocation *_find_large_allocation(uintptr_t start) const noexcept
+        {
+            const auto *record = _large_allocations[_large_allocation_bucket(start)];
+
+            while (record != nullptr && record->start != start) {
+                record = record->next;
+            }
+            return record;
+        }
+
+        /** A free page of the heap area */
+        struct free_page_link
+        {
+            free_page_link *prev;
+            free_page_link *next;
+        };
+
+        void _push_free_page(free_page_link *page) noexcept;
+
+        void _remove_free_page(free_page_link *page) noexcept;
+
+        bool _grow() noexcept;
+
+        void _shrink(std::size_t chunk) noexcept;
+
+        /** Take a whole free chunk of the heap area, for a slab of one of the largest classes */
+        void *_allocate_chunk() noexcept;
+
+        void _free_chunk(void *start) noexcept;
+
+        /** Get the slab holding a small allocation, whose size depends on its chunk */
+        slab *_slab_of(const void *ptr) const noexcept
+        {
+            return _slab_chunks[_chunk_of(ptr)] ? slab::of(ptr, chunk_size) : slab::of(ptr);
+        }
+
+        std::size_t _chunk_of(const void *page) const noexcept
+        {
+            return (reinterpret_cast<uintptr_t>(page) - _start_addr.value()) / chunk_size;
+        }
+
+        virtual_address _chunk_address(std::size_t chunk) const noexcept
+        {
+            return _start_addr + chunk * chunk_size;
+        }
+
+        bool _in_heap_area(const void *ptr) const noexcept
+        {
+            return _start_addr.value() <= reinterpret_cast<uintptr_t>(ptr) &&
+                   reinterpret_cast<uintptr_t>(ptr) < _end_addr.value();
+        }
+
         std::optional<memory::physical_frame_allocator> _frame_allocator;
-    public:
+        std::optional<memory::frame_database> _frame_database;
+        std::optional<memory::buddy_frame_allocator> _buddy_allocator;
+        std::optional<memory::per_cpu_frame_cache> _frame_cache;
+        std::optional<memory::zeroed_frame_pool> _zeroed_frames;
+        std::optional<memory::virtual_range_allocator> _virtual_ranges;
+        /** Slabs with free objects, for each size class */
+        slab_list _partial_slabs[size_classes_count];
+        /** Records of the live large allocations, hashed by address */
+        large_allocation *_large_allocations[large_allocation_buckets]{};
+        /** Free pages of the mapped chunks, chained through their first words */
+        free_page_link *_free_pages{nullptr};
+        /** Number of free pages in each chunk, so that entirely free chunks can be given back */
+        uint16_t _chunk_free_pages[max_chunks]{};
+        /** Chunks used as a single slab by one of the largest classes */
+        bool _slab_chunks[max_chunks]{};
+        /** Chunks given back below _next_chunk, to be mapped again before any new one */
+        uint16_t _unmapped_chunks[max_chunks]{};
+        std::size_t _unmapped_chunks_count{0};
+        std::size_t _next_chunk{0};
+        std::size_t _mapped_chunks{0};
+        std::size_t _used_pages{0};
+        statistics _stats{};
+        heap_profiler _profiler{};
         virtual_address _start_addr{0};
         virtual_address _end_addr{0};
-        virtual_address _current_addr{0};
     };
 
     template <typename T>
@@ -0,0 +1,233 @@
+/*
+** Created by doom on 18/10/26.
+*/
+
+#ifndef FOROS_MEMORY_KMEM_CACHE_HPP
+#define FOROS_MEMORY_KMEM_CACHE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <utility>
+#include <core/compiler_hints.hpp>
+#include <core/cpu.hpp>
+#include <core/panic.hpp>
+#include <memory/definitions.hpp>
+#include <memory/kernel_heap.hpp>
+#include <memory/slab.hpp>
+
+namespace foros::memory
+{
+    /**
+     * A cache of objects of a single type, stored in slabs of their own taken from the kernel heap.
+     *
+     * Objects of the same type are packed together, and allocating or freeing one is a push or a pop on the
+     * free list of a slab. Successive slabs start their objects at different offsets (their color), so that
+     * the objects at the same index of different slabs do not compete for the same cache sets.
+     *
+     * When KeepConstructed is set, objects are default-constructed once, when their slab is created, and only
+     * destroyed when the slab is given back. Freed objects keep their state, which the caller must leave
+     * ready for reuse, so objects with costly initialization (locks, lists, buffers) skip it on most allocations.
+     */
+    template <typename T, bool KeepConstructed = false>
+    class kmem_cache
+    {
+        /** Free objects which keep their state are chained through a word past them */
+        static constexpr const std::size_t link_offset =
+            KeepConstructed ? (sizeof(T) + alignof(void *) - 1) & ~(alignof(void *) - 1) : 0;
+
+        static constexpr const std::size_t object_align =
+            alignof(T) > alignof(void *) ? alignof(T) : alignof(void *);
+
+        static constexpr std::size_t _stride() noexcept
+        {
+            const auto size = KeepConstructed ? link_offset + sizeof(void *) :
+                              (sizeof(T) > sizeof(void *) ? sizeof(T) : sizeof(void *));
+
+            return (size + object_align - 1) & ~(object_align - 1);
+        }
+
+    public:
+        /** Distance between two objects of a slab */
+        static constexpr const std::size_t object_stride = _stride();
+
+        static constexpr const std::size_t objects_per_slab =
+            (page_size - slab::first_offset_for(object_align, 0)) / object_stride;
+
+        static_assert(objects_per_slab > 0, "objects are too large to be cached in slabs");
+
+        /** Number of empty slabs kept around instead of being given back to the heap */
+        static constexpr const std::size_t max_empty_slabs = 1;
+
+        /** Tag of the slabs of typed caches, which are never size classes of the heap */
+        static constexpr const uint32_t slab_owner = 0xca11ab1e;
+
+        kmem_cache() noexcept = default;
+
+        kmem_cache(const kmem_cache &) = delete;
+
+        kmem_cache &operator=(const kmem_cache &) = delete;
+
+        ~kmem_cache() noexcept
+        {
+            kassert(_objects_in_use == 0, "kmem_cache: destroyed while objects are still in use");
+            shrink();
+        }
+
+        /**
+         * Allocate an object. Without KeepConstructed, it is constructed from the arguments, otherwise the
+         * object is returned in the state in which it was freed.
+         *
+         * @param args          the arguments forwarded to the constructor of the object
+         *
+         * @return              on success, the object
+         *                      on failure, nullptr
+         */
+        template <typename ...Args>
+        T *allocate(Args &&...args) noexcept
+        {
+            static_assert(!KeepConstructed || sizeof...(Args) == 0,
+                          "objects of caches keeping them constructed are only default-constructed");
+
+            if unlikely(_partial.empty() && !_refill()) {
+                return nullptr;
+            }
+
+            auto *s = _partial.front();
+            void *obj = s->pop();
+
+            if (s->full()) {
+                _partial.remove(s);
+                _full.push_front(s);
+            }
+            ++_objects_in_use;
+            if constexpr (KeepConstructed) {
+                return static_cast<T *>(obj);
+            } else {
+                return new (obj) T(std::forward<Args>(args)...);
+            }
+        }
+
+        /**
+         * Give an object back to the cache
+         *
+         * @param obj           the object, allocated from this cache
+         */
+        void deallocate(T *obj) noexcept
+        {
+            if (obj == nullptr) {
+                return;
+            }
+
+            auto *s = slab::of(obj);
+            kassert(s->owner == slab_owner && s->object_size == object_stride,
+                    "kmem_cache::deallocate: object does not come from this cache");
+            if constexpr (!KeepConstructed) {
+                obj->~T();
+            }
+
+            const bool was_full = s->full();
+            s->push(obj);
+            --_objects_in_use;
+            if (was_full) {
+                _full.remove(s);
+                _partial.push_front(s);
+            }
+            if (s->empty()) {
+                _partial.remove(s);
+                if (_empty_count < max_empty_slabs) {
+                    _empty.push_front(s);
+                    ++_empty_count;
+                } else {
+                    _release(s);
+                }
+            }
+        }
+
+        /**
+         * Give every empty slab back to the kernel heap
+         */
+        void shrink() noexcept
+        {
+            while (!_empty.empty()) {
+                auto *s = _empty.front();
+
+                _empty.remove(s);
+                _release(s);
+            }
+            _empty_count = 0;
+        }
+
+        std::size_t objects_in_use() const noexcept
+        {
+            return _objects_in_use;
+        }
+
+        std::size_t slabs_count() const noexcept
+        {
+            return _slabs_count;
+        }
+
+    private:
+        /** Make a slab with free objects available, reusing an empty one if possible */
+        bool _refill() noexcept
+        {
+            if (!_empty.empty()) {
+                auto *s = _empty.front();
+
+                _empty.remove(s);
+                --_empty_count;
+                _partial.push_front(s);
+                return true;
+            }
+
+            void *page = kernel_heap::instance().allocate_page();
+            if (page == nullptr) {
+                return false;
+            }
+
+            auto *s = slab::create(page, object_stride, object_align, _next_color, slab_owner, link_offset);
+            if constexpr (KeepConstructed) {
+                for (std::size_t i = 0; i < s->capacity; ++i) {
+                    new (s->object_at(i)) T();
+                }
+            }
+            _next_color += _color_step;
+            if (_next_color > _max_color) {
+                _next_color = 0;
+            }
+            _partial.push_front(s);
+            ++_slabs_count;
+            return true;
+        }
+
+        void _release(slab *s) noexcept
+        {
+            if constexpr (KeepConstructed) {
+                for (std::size_t i = 0; i < s->capacity; ++i) {
+                    static_cast<T *>(s->object_at(i))->~T();
+                }
+            }
+            kernel_heap::instance().free_page(s);
+            --_slabs_count;
+        }
+
+        /** Colors move by whole cache lines, and by whole objects when they are aligned on more than that */
+        static constexpr const std::size_t _color_step =
+            object_align > cache_line_size ? object_align : cache_line_size;
+
+        /** Largest color which does not make a slab lose an object */
+        static constexpr const std::size_t _max_color =
+            page_size - slab::first_offset_for(object_align, 0) - objects_per_slab * object_stride;
+
+        slab_list _partial;
+        slab_list _full;
+        slab_list _empty;
+        std::size_t _empty_count{0};
+        std::size_t _slabs_count{0};
+        std::size_t _objects_in_use{0};
+        std::size_t _next_color{0};
+    };
+}
+
+#endif /* !FOROS_MEMORY_KMEM_CACHE_HPP */
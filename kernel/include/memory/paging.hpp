@@ -5,13 +5,20 @@
 #ifndef FOROS_MEMORY_PAGING_HPP
 #define FOROS_MEMORY_PAGING_HPP
 
+#include <algorithm>
 #include <climits>
 #include <cstdint>
+#include <type_traits>
 #include <st/st.hpp>
 #include <utils/optional.hpp>
 #include <arch/x86_64/instructions.hpp>
+#include <arch/x86_64/registers.hpp>
+#include <core/cpu.hpp>
 #include <memory/definitions.hpp>
 #include <memory/physical_frame.hpp>
+#include <memory/frame_database.hpp>
+#include <memory/tlb.hpp>
+#include <memory/translation_cache.hpp>
 
 namespace foros::memory
 {
@@ -19,6 +26,19 @@ namespace foros::memory
 
     namespace details
     {
+        /** Whether a frame allocator can hand out frames that are already filled with zeros */
+        template <typename FrameAllocator, typename = void>
+        struct provides_zeroed_frames : std::false_type
+        {
+        };
+
+        template <typename FrameAllocator>
+        struct provides_zeroed_frames<FrameAllocator,
+                                      std::void_t<decltype(std::declval<FrameAllocator &>().allocate_zeroed_frame())>>
+            : std::true_type
+        {
+        };
+
         struct page_entry_flags :
             public st::type_base<uint64_t>,
             public st::traits::bitwise_manipulable<page_entry_flags>
@@ -115,6 +135,43 @@ namespace foros::memory
         }
     };
 
+    /** Sizes of the pages that can be mapped directly by upper-level entries */
+    enum class huge_page_size
+    {
+        /** Mapped by a P2 entry */
+        size_2m,
+        /** Mapped by a P3 entry, only if the CPU supports it */
+        size_1g,
+    };
+
+    /**
+     * Get the number of frames covered by a huge page
+     *
+     * @param size          the size of the huge page
+     *
+     * @return              the number of frames
+     */
+    constexpr std::size_t frames_count_for(huge_page_size size) noexcept
+    {
+        return (size == huge_page_size::size_2m ? page_size_2m : page_size_1g) / page_size;
+    }
+
+    /**
+     * Memory types a mapping can use, once initialize_pat() has programmed the page attribute table.
+     * Their values are the PAT entries selected by the PWT (bit 0) and PCD (bit 1) flags of an entry, so they are
+     * encoded the same way in 4KB and huge page entries.
+     */
+    enum class memory_type : uint8_t
+    {
+        write_back = 0,
+        /** Stores are buffered and combined into bursts, without caching: meant for framebuffers */
+        write_combining = 1,
+        /** Uncached, unless an MTRR makes the range write-combining */
+        uncached_minus = 2,
+        /** Strongly uncached: meant for device registers */
+        uncached = 3,
+    };
+
     struct page_table_entry : public st::type_base<uint64_t>
     {
     public:
@@ -145,6 +202,17 @@ namespace foros::memory
             value() = 0;
         }
 
+        /**
+         * Check whether this entry directly maps a huge page instead of pointing to the next table
+         *
+         * @return              if the entry maps a huge page, true
+         *                      otherwise, false
+         */
+        bool is_huge_page() const noexcept
+        {
+            return entry_flags().has(flags::present) && entry_flags().has(flags::huge_page);
+        }
+
         /**
          * Get the flags associated with this page table entry
          *
@@ -158,6 +226,32 @@ namespace foros::memory
             return flags(value() & (flags_only_mask.value()));
         }
 
+        /**
+         * Get the flags selecting a memory type, to combine with the other flags of an entry
+         *
+         * @param type          the memory type
+         *
+         * @return              the entry flags
+         */
+        static flags memory_type_flags(memory_type type) noexcept
+        {
+            const auto index = static_cast<uint8_t>(type);
+
+            return flags((index & 1 ? flags::write_through.value() : 0) | (index & 2 ? flags::no_cache.value() : 0));
+        }
+
+        /**
+         * Get the memory type used by this entry
+         *
+         * @return              the memory type
+         */
+        memory_type get_memory_type() const noexcept
+        {
+            const auto fl = entry_flags();
+
+            return static_cast<memory_type>((fl.has(flags::write_through) ? 1 : 0) | (fl.has(flags::no_cache) ? 2 : 0));
+        }
+
         /**
          * Get the frame to which this page is mapped
          *
@@ -188,7 +282,7 @@ namespace foros::memory
             kassert((f.start_address().value() & ~addr_only_mask) == 0,
                     "page_table_entry::set_frame: invalid address for physical_frame");
             kassert((~flags_only_mask & fl).value() == 0, "page_table_entry::set_frame: invalid flags");
-            value() = f.value() | fl.value();
+            value() = f.start_address().value() | fl.value();
         }
 
         /**
@@ -328,7 +422,8 @@ namespace foros::memory
          *
          * @return              a reference to the newly created table
          */
-        page_table<next_level_type> &allocate_next_table(size_t index, physical_frame_allocator &al) noexcept
+        template <typename FrameAllocator>
+        page_table<next_level_type> &allocate_next_table(size_t index, FrameAllocator &al) noexcept
         {
             auto next_opt = next_table(index);
 
@@ -336,13 +431,20 @@ namespace foros::memory
                 return next_opt.unwrap();
             }
             kassert(!entries[index].entry_flags().has(page_table_entry::flags::huge_page),
-                    "page_table::allocate_next_table: huge pages are not supported");
-            auto frame = al.allocate_frame()
-                .unwrap_or_panic("page_table::allocate_next_table: unable to allocate a physical_frame");
-            entries[index].set_frame(frame, page_table_entry::flags::present | page_table_entry::flags::writable);
-            auto &next = next_table(index).unwrap();
-            next.clear();
-            return next;
+                    "page_table::allocate_next_table: entry is mapped as a huge page");
+            if constexpr (details::provides_zeroed_frames<FrameAllocator>::value) {
+                auto frame = al.allocate_zeroed_frame()
+                    .unwrap_or_panic("page_table::allocate_next_table: unable to allocate a physical_frame");
+                entries[index].set_frame(frame, page_table_entry::flags::present | page_table_entry::flags::writable);
+                return next_table(index).unwrap();
+            } else {
+                auto frame = al.allocate_frame()
+                    .unwrap_or_panic("page_table::allocate_next_table: unable to allocate a physical_frame");
+                entries[index].set_frame(frame, page_table_entry::flags::present | page_table_entry::flags::writable);
+                auto &next = next_table(index).unwrap();
+                next.clear();
+                return next;
+            }
         }
     };
 
@@ -368,9 +470,280 @@ namespace foros::memory
             return *p4;
         }
 
+        static physical_frame _root_frame() noexcept
+        {
+            return physical_frame::for_address(physical_address(arch::registers::cr3() & 0x000ffffffffff000));
+        }
+
+        /**
+         * The number of live entries of each page table is kept in the frame database, as the reference count of
+         * the frame holding the table, plus one for the entry of the parent table. Only the tables created once
+         * tracking is enabled are counted (and thus reclaimed), so the tables set up by the boot code stay.
+         */
+        static inline frame_database *_page_tables{nullptr};
+
+        static inline bool _kernel_tables_preallocated{false};
+
+        static bool _is_tracked(physical_frame table) noexcept
+        {
+            return _page_tables && _page_tables->contains(table) &&
+                   (*_page_tables)[table].owner == frame_owner::page_table;
+        }
+
+        static void _entries_added(physical_frame table, std::size_t count) noexcept
+        {
+            if (_is_tracked(table)) {
+                _page_tables->get(table, count);
+            }
+        }
+
+        /** Account for removed entries, and tell whether the table is now empty */
+        static bool _entries_removed(physical_frame table, std::size_t count) noexcept
+        {
+            return _is_tracked(table) && _page_tables->put(table, count) == 1;
+        }
+
+        /** Get the next table at a given index, creating it if needed, along with the frame holding it */
+        template <typename Table, typename FrameAllocator>
+        static auto &_next_table(Table &table, physical_frame table_frame, std::size_t index,
+                                 FrameAllocator &al, physical_frame &next_frame) noexcept
+        {
+            const bool existed = table.next_table(index).has_value();
+            auto &next = table.allocate_next_table(index, al);
+
+            next_frame = table[index].get_frame().unwrap();
+            if (!existed) {
+                if (_page_tables && _page_tables->contains(next_frame)) {
+                    _page_tables->assign({next_frame.value(), next_frame.value() + 1}, frame_owner::page_table);
+                }
+                _entries_added(table_frame, 1);
+            }
+            return next;
+        }
+
+        /**
+         * Find the P3 table covering a page, creating it if needed. The P4 table is the one of the active address
+         * space, so once other address spaces exist, kernel P4 entries must not be created there anymore.
+         */
+        template <typename FrameAllocator>
+        static p3_table &_p3_table(page p, FrameAllocator &al, physical_frame &p3_frame) noexcept
+        {
+            kassert(!_kernel_tables_preallocated || !is_kernel_p4_index(p.p4_index()) ||
+                    root_p4_table().next_table(p.p4_index()).has_value(),
+                    "mapper: kernel P4 entries cannot change once they are shared by address spaces");
+            return _next_table(root_p4_table(), _root_frame(), p.p4_index(), al, p3_frame);
+        }
+
+        /** Find the P1 table covering a page, creating the missing tables on the way */
+        template <typename FrameAllocator>
+        static p1_table &_allocate_p1_table(page p, FrameAllocator &al, physical_frame &p1_frame) noexcept
+        {
+            physical_frame p3_frame;
+            physical_frame p2_frame;
+            auto &p3 = _p3_table(p, al, p3_frame);
+            auto &p2 = _next_table(p3, p3_frame, p.p3_index(), al, p2_frame);
+
+            return _next_table(p2, p2_frame, p.p2_index(), al, p1_frame);
+        }
+
+        /**
+         * Account for entries removed from the table of a given level covering a page, and free that table if it
+         * became empty, going up for as long as the parent tables become empty as well
+         *
+         * @param p             a page covered by the table
+         * @param level         the level of the table (1 for a P1 table, up to 3 for a P3 table)
+         * @param count         the number of entries removed from the table
+         * @param batch         the batch in which to record the invalidation of the freed tables, whose flush
+         *                      gives them back
+         * @param al            the physical allocator to which the freed tables are given back
+         */
+        template <typename FrameAllocator>
+        static void _release_tables(page p, std::size_t level, std::size_t count, tlb_flush_batch &batch,
+                                    FrameAllocator &al) noexcept
+        {
+            if (!_page_tables) {
+                return;
+            }
+
+            auto &p4 = root_p4_table();
+            auto &p3 = p4.next_table(p.p4_index()).unwrap();
+            p2_table *p2 = level <= 2 ? &p3.next_table(p.p3_index()).unwrap() : nullptr;
+            p1_table *p1 = level <= 1 ? &p2->next_table(p.p2_index()).unwrap() : nullptr;
+
+            /** Indexed by level: the table itself, and the entry of its parent pointing to it */
+            const uintptr_t tables[] = {0, (uintptr_t)p1, (uintptr_t)p2, (uintptr_t)&p3};
+            page_table_entry *parent_entries[] = {nullptr,
+                                                  p2 ? &(*p2)[p.p2_index()] : nullptr,
+                                                  level <= 2 ? &p3[p.p3_index()] : nullptr,
+                                                  &p4[p.p4_index()]};
+
+            for (; level <= 3; ++level, count = 1) {
+                auto &parent_entry = *parent_entries[level];
+                const auto frame = parent_entry.get_frame().unwrap();
+
+                /** The P3 tables of the kernel entries are shared by every address space, so they have to stay */
+                if (!_entries_removed(frame, count) || (level == 3 && is_kernel_p4_index(p.p4_index()))) {
+                    return;
+                }
+                parent_entry.set_unused();
+                _page_tables->release(frame);
+                /** The table stays reachable through its recursive mapping until the batch is flushed */
+                batch.add(virtual_address(tables[level]));
+                batch.defer_free(frame, al);
+            }
+        }
+
+        /** Unmap consecutive pages, giving their frames back to the allocator only if requested */
+        template <typename FrameAllocator>
+        static void _unmap_range(page first_page, std::size_t pages_count, FrameAllocator &al,
+                                 tlb_flush_batch &batch, bool free_frames) noexcept
+        {
+            std::size_t done = 0;
+
+            while (done < pages_count) {
+                const auto p = page(first_page.value() + done);
+                auto &p1 = root_p4_table().next_table(p.p4_index()).and_then([&p](auto &&p3) {
+                    return p3.next_table(p.p3_index());
+                }).and_then([&p](auto &&p2) {
+                    return p2.next_table(p.p2_index());
+                }).unwrap_or_panic("mapper::unmap_range: attempted to unmap an unmapped page");
+                const auto first_index = p.p1_index();
+                const auto count = std::min(pages_count - done, page_entries_count - first_index);
+
+                for (std::size_t i = 0; i < count; ++i) {
+                    auto &entry = p1[first_index + i];
+                    auto frame = entry.get_frame()
+                        .unwrap_or_panic("mapper::unmap_range: attempted to unmap an unmapped page");
+
+                    batch.add(page(p.value() + i).start_address(),
+                              entry.entry_flags().has(page_table_entry::flags::global));
+                    entry.set_unused();
+                    translation_cache::instance().invalidate(p.value() + i);
+                    if (free_frames) {
+                        batch.defer_free(frame, al);
+                    }
+                }
+                _release_tables(p, 1, count, batch, al);
+                done += count;
+            }
+        }
+
+        /**
+         * Map consecutive pages, descending the page table hierarchy only once per P1 table
+         *
+         * @param first_page    the first page to map
+         * @param pages_count   the number of pages to map
+         * @param entry_flags   the flags to apply to the pages
+         * @param al            the physical allocator used to allocate page tables
+         * @param frame_for     a function returning the frame to map the n-th page to
+         */
+        template <typename FrameAllocator, typename FrameSource>
+        static void _map_range(page first_page, std::size_t pages_count, page_table_entry::flags entry_flags,
+                               FrameAllocator &al, FrameSource &&frame_for) noexcept
+        {
+            const auto present_flags = entry_flags | page_table_entry::flags::present;
+            std::size_t done = 0;
+
+            while (done < pages_count) {
+                const auto p = page(first_page.value() + done);
+                physical_frame p1_frame;
+                auto &p1 = _allocate_p1_table(p, al, p1_frame);
+                const auto first_index = p.p1_index();
+                const auto count = std::min(pages_count - done, page_entries_count - first_index);
+
+                for (std::size_t i = 0; i < count; ++i) {
+                    auto &entry = p1[first_index + i];
+
+                    kassert(entry.is_unused(), "mapper::map_range: page already in use");
+                    entry.set_frame(frame_for(done + i), present_flags);
+                    translation_cache::instance().invalidate(p.value() + i);
+                }
+                _entries_added(p1_frame, count);
+                done += count;
+            }
+        }
+
+        /** Walk the page tables to find the frame to which a page is mapped */
+        static utils::optional<physical_frame> _walk(page p) noexcept
+        {
+            auto p3opt = root_p4_table().next_table(p.p4_index());
+
+            if (!p3opt) {
+                return std::nullopt;
+            }
+
+            const auto &p3_entry = p3opt.unwrap()[p.p3_index()];
+            if (p3_entry.is_huge_page()) {
+                /** The P2 and P1 indexes of the page are its offset into the 1GB page */
+                return {p3_entry.get_frame().unwrap() + (p.p2_index() * page_entries_count + p.p1_index())};
+            }
+
+            auto p2opt = p3opt.unwrap().next_table(p.p3_index());
+            if (!p2opt) {
+                return std::nullopt;
+            }
+
+            const auto &p2_entry = p2opt.unwrap()[p.p2_index()];
+            if (p2_entry.is_huge_page()) {
+                /** The P1 index of the page is its offset into the 2MB page */
+                return {p2_entry.get_frame().unwrap() + p.p1_index()};
+            }
+
+            return p2opt.unwrap().next_table(p.p2_index()).and_then([&p](auto &&p1) {
+                return p1[p.p1_index()].get_frame();
+            });
+        }
+
     public:
         /**
-         * Obtain the physical frame to which a page is mapped
+         * Start counting the live entries of the page tables created from now on, so that they can be freed
+         * once they become empty
+         *
+         * @param db            the frame database in which to keep the counts
+         */
+        static void track_page_tables(frame_database &db) noexcept
+        {
+            _page_tables = &db;
+        }
+
+        /**
+         * Create the P3 tables of every kernel P4 entry. The kernel P4 entries never change afterwards, so each
+         * address space can copy them once and still see every kernel mapping made later on.
+         *
+         * @param al            the physical allocator used to allocate the tables
+         */
+        template <typename FrameAllocator>
+        static void preallocate_kernel_tables(FrameAllocator &al) noexcept
+        {
+            for (std::size_t i = 0; i < page_entries_count; ++i) {
+                if (is_kernel_p4_index(i)) {
+                    physical_frame p3_frame;
+
+                    _next_table(root_p4_table(), _root_frame(), i, al, p3_frame);
+                }
+            }
+            _kernel_tables_preallocated = true;
+        }
+
+        static bool kernel_tables_preallocated() noexcept
+        {
+            return _kernel_tables_preallocated;
+        }
+
+        /**
+         * Stop tracking a page table which is about to be freed without going through the mapper
+         *
+         * @param frame         the frame holding the table
+         */
+        static void forget_page_table(physical_frame frame) noexcept
+        {
+            if (_is_tracked(frame)) {
+                _page_tables->release(frame);
+            }
+        }
+
+        /**
+         * Obtain the physical frame to which a page is mapped, going through the translation cache
          *
          * @param p             the page
          *
@@ -379,19 +752,18 @@ namespace foros::memory
          */
         static utils::optional<physical_frame> get_frame_for_page(page p) noexcept
         {
-            auto p3opt = root_p4_table().next_table(p.p4_index());
+            auto &cache = translation_cache::instance();
+            auto cached = cache.lookup(p.value());
 
-            auto r = p3opt.and_then([&p](auto &&p3) {
-                return p3.next_table(p.p3_index());
-            }).and_then([&p](auto &&p2) {
-                return p2.next_table(p.p2_index());
-            }).and_then([&p](auto &&p1) {
-                return p1[p.p1_index()].get_frame();
-            });
-
-            //TODO: support huge pages
+            if (cached) {
+                return cached;
+            }
 
-            return r;
+            auto frame_opt = _walk(p);
+            if (frame_opt) {
+                cache.insert(p.value(), frame_opt.unwrap());
+            }
+            return frame_opt;
         }
 
         /**
@@ -415,16 +787,55 @@ namespace foros::memory
          * @param entry_flags   the flags to apply to the page
          * @param al            the physical allocator used to allocate physical frames
          */
+        template <typename FrameAllocator>
         static void map_page_to_frame(physical_frame frame,
                                       page p, page_table_entry::flags entry_flags,
-                                      physical_frame_allocator &al) noexcept
+                                      FrameAllocator &al) noexcept
         {
-            auto &p3 = root_p4_table().allocate_next_table(p.p4_index(), al);
-            auto &p2 = p3.allocate_next_table(p.p3_index(), al);
-            auto &p1 = p2.allocate_next_table(p.p2_index(), al);
+            physical_frame p1_frame;
+            auto &p1 = _allocate_p1_table(p, al, p1_frame);
 
             kassert(p1[p.p1_index()].is_unused(), "mapper::map_page_to_frame: page already in use");
             p1[p.p1_index()].set_frame(frame, entry_flags | page_table_entry::flags::present);
+            _entries_added(p1_frame, 1);
+            translation_cache::instance().invalidate(p.value());
+        }
+
+        /**
+         * Map a huge page to a block of frames
+         *
+         * @param frame         the first frame of the block, aligned on the size of the page
+         * @param p             the first page of the huge page, aligned on the size of the page
+         * @param size          the size of the huge page
+         * @param entry_flags   the flags to apply to the page
+         * @param al            the physical allocator used to allocate page tables
+         */
+        template <typename FrameAllocator>
+        static void map_huge_page_to_frame(physical_frame frame, page p, huge_page_size size,
+                                           page_table_entry::flags entry_flags, FrameAllocator &al) noexcept
+        {
+            const auto frames_count = frames_count_for(size);
+            const auto huge_flags = entry_flags | page_table_entry::flags::present |
+                                    page_table_entry::flags::huge_page;
+
+            kassert(frame.value() % frames_count == 0 && p.value() % frames_count == 0,
+                    "mapper::map_huge_page_to_frame: misaligned page or frame");
+            physical_frame p3_frame;
+            auto &p3 = _p3_table(p, al, p3_frame);
+
+            if (size == huge_page_size::size_1g) {
+                kassert(cpu_supports_1g_pages(), "mapper::map_huge_page_to_frame: 1GB pages are not supported");
+                kassert(p3[p.p3_index()].is_unused(), "mapper::map_huge_page_to_frame: page already in use");
+                p3[p.p3_index()].set_frame(frame, huge_flags);
+                _entries_added(p3_frame, 1);
+            } else {
+                physical_frame p2_frame;
+                auto &p2 = _next_table(p3, p3_frame, p.p3_index(), al, p2_frame);
+
+                kassert(p2[p.p2_index()].is_unused(), "mapper::map_huge_page_to_frame: page already in use");
+                p2[p.p2_index()].set_frame(frame, huge_flags);
+                _entries_added(p2_frame, 1);
+            }
         }
 
         /**
@@ -434,14 +845,49 @@ namespace foros::memory
          * @param entry_flags   the flags to apply to the page
          * @param al            the physical allocator used to allocate physical frames
          */
+        template <typename FrameAllocator>
         static void map_page(page p, page_table_entry::flags entry_flags,
-                             physical_frame_allocator &al) noexcept
+                             FrameAllocator &al) noexcept
         {
             auto frame = al.allocate_frame().unwrap_or_panic("mapper::map_page: unable to allocate a physical frame");
 
             map_page_to_frame(frame, p, entry_flags, al);
         }
 
+        /**
+         * Map consecutive pages to a range of consecutive frames
+         *
+         * @param first_page    the first page to map
+         * @param frames        the frames to map the pages to
+         * @param entry_flags   the flags to apply to the pages
+         * @param al            the physical allocator used to allocate page tables
+         */
+        template <typename FrameAllocator>
+        static void map_range(page first_page, frame_range frames, page_table_entry::flags entry_flags,
+                              FrameAllocator &al) noexcept
+        {
+            _map_range(first_page, frames.size(), entry_flags, al, [&frames](std::size_t n) {
+                return physical_frame(frames.start + n);
+            });
+        }
+
+        /**
+         * Map consecutive pages to newly allocated frames
+         *
+         * @param first_page    the first page to map
+         * @param pages_count   the number of pages to map
+         * @param entry_flags   the flags to apply to the pages
+         * @param al            the physical allocator used to allocate physical frames
+         */
+        template <typename FrameAllocator>
+        static void map_range(page first_page, std::size_t pages_count, page_table_entry::flags entry_flags,
+                              FrameAllocator &al) noexcept
+        {
+            _map_range(first_page, pages_count, entry_flags, al, [&al](std::size_t) {
+                return al.allocate_frame().unwrap_or_panic("mapper::map_range: unable to allocate a physical frame");
+            });
+        }
+
         /**
          * Map a physical frame to the equivalent virtual address
          *
@@ -449,9 +895,10 @@ namespace foros::memory
          * @param entry_flags   the flags to apply to the page
          * @param al            the physical allocator used to allocate physical frames
          */
+        template <typename FrameAllocator>
         static void identity_map_frame(physical_frame frame,
                                        page_table_entry::flags entry_flags,
-                                       physical_frame_allocator &al) noexcept
+                                       FrameAllocator &al) noexcept
         {
             auto page = page::for_address(virtual_address(frame.start_address().value()));
 
@@ -460,12 +907,15 @@ namespace foros::memory
 
         /**
          * Unmap a previously mapped memory page.
-         * After unmapping, any access to the memory in that page will trigger a page fault
+         * After unmapping, any access to the memory in that page will trigger a page fault.
+         * The page tables which become empty are freed as well
          *
          * @param p             the page to unmap
-         * @param al            the physical allocator used to allocate physical frames
+         * @param al            the physical allocator to which the frame and the page tables are given back
+         * @param batch         the batch in which to record the TLB invalidation, whose flush frees the frame
          */
-        static void unmap(page p, physical_frame_allocator &al)
+        template <typename FrameAllocator>
+        static void unmap(page p, FrameAllocator &al, tlb_flush_batch &batch)
         {
             auto p3opt = root_p4_table().next_table(p.p4_index());
 
@@ -476,10 +926,111 @@ namespace foros::memory
             });
 
             auto &p1 = p1opt.unwrap_or_panic("mapper::unmap: attempted to unmap an already unmapped frame");
-            auto frame = p1[p.p1_index()].get_frame().unwrap();
-            p1[p.p1_index()].set_unused();
-            al.deallocate_frame(frame);
-            arch::instructions::invlpg(p.start_address().value());
+            auto &entry = p1[p.p1_index()];
+            auto frame = entry.get_frame().unwrap();
+
+            batch.add(p.start_address(), entry.entry_flags().has(page_table_entry::flags::global));
+            entry.set_unused();
+            translation_cache::instance().invalidate(p.value());
+            batch.defer_free(frame, al);
+            _release_tables(p, 1, 1, batch, al);
+        }
+
+        template <typename FrameAllocator>
+        static void unmap(page p, FrameAllocator &al)
+        {
+            tlb_flush_batch batch;
+
+            unmap(p, al, batch);
+        }
+
+        /**
+         * Unmap consecutive pages, descending the page table hierarchy only once per P1 table.
+         * Each P1 table left empty is freed right away, along with the parent tables it leaves empty, so whole
+         * subtrees are reclaimed in the same pass
+         *
+         * @param first_page    the first page to unmap
+         * @param pages_count   the number of pages to unmap
+         * @param al            the physical allocator to which the frames and the page tables are given back
+         * @param batch         the batch in which to record the TLB invalidations, whose flush frees the frames
+         */
+        template <typename FrameAllocator>
+        static void unmap_range(page first_page, std::size_t pages_count, FrameAllocator &al,
+                                tlb_flush_batch &batch) noexcept
+        {
+            _unmap_range(first_page, pages_count, al, batch, true);
+        }
+
+        template <typename FrameAllocator>
+        static void unmap_range(page first_page, std::size_t pages_count, FrameAllocator &al) noexcept
+        {
+            tlb_flush_batch batch;
+
+            unmap_range(first_page, pages_count, al, batch);
+        }
+
+        /**
+         * Unmap consecutive pages mapping memory which does not belong to the frame allocator, such as device
+         * memory. The frames are left alone, only the page tables which become empty are freed
+         *
+         * @param first_page    the first page to unmap
+         * @param pages_count   the number of pages to unmap
+         * @param al            the physical allocator to which the page tables are given back
+         */
+        template <typename FrameAllocator>
+        static void unmap_physical_range(page first_page, std::size_t pages_count, FrameAllocator &al) noexcept
+        {
+            tlb_flush_batch batch;
+
+            _unmap_range(first_page, pages_count, al, batch, false);
+        }
+
+        /**
+         * Unmap a previously mapped huge page.
+         * The frames backing it are not freed, since they usually come from an allocator of contiguous blocks,
+         * but the page tables which become empty are
+         *
+         * @param p             the first page of the huge page
+         * @param size          the size of the huge page
+         * @param al            the physical allocator to which the page tables are given back
+         * @param batch         the batch in which to record the TLB invalidation
+         *
+         * @return              the first frame of the block that was mapped
+         */
+        template <typename FrameAllocator>
+        static physical_frame unmap_huge_page(page p, huge_page_size size, FrameAllocator &al,
+                                              tlb_flush_batch &batch) noexcept
+        {
+            auto &p3 = root_p4_table().next_table(p.p4_index())
+                .unwrap_or_panic("mapper::unmap_huge_page: attempted to unmap an unmapped page");
+            auto *entry = &p3[p.p3_index()];
+
+            if (size == huge_page_size::size_2m) {
+                entry = &p3.next_table(p.p3_index())
+                    .unwrap_or_panic("mapper::unmap_huge_page: attempted to unmap an unmapped page")[p.p2_index()];
+            }
+            kassert(entry->is_huge_page(), "mapper::unmap_huge_page: page is not a huge page of this size");
+            auto frame = entry->get_frame().unwrap();
+            /** A single invalidation drops the whole huge page from the TLB */
+            batch.add(p.start_address(), entry->entry_flags().has(page_table_entry::flags::global));
+            entry->set_unused();
+            if (size == huge_page_size::size_1g) {
+                translation_cache::instance().invalidate_all();
+            } else {
+                for (std::size_t i = 0; i < frames_count_for(size); ++i) {
+                    translation_cache::instance().invalidate(p.value() + i);
+                }
+            }
+            _release_tables(p, size == huge_page_size::size_1g ? 3 : 2, 1, batch, al);
+            return frame;
+        }
+
+        template <typename FrameAllocator>
+        static physical_frame unmap_huge_page(page p, huge_page_size size, FrameAllocator &al) noexcept
+        {
+            tlb_flush_batch batch;
+
+            return unmap_huge_page(p, size, al, batch);
         }
     };
 }
@@ -0,0 +1,73 @@
+/*
+** Created by doom on 18/10/26.
+*/
+
+#ifndef FOROS_MEMORY_PAT_HPP
+#define FOROS_MEMORY_PAT_HPP
+
+#include <cstdint>
+#include <arch/x86_64/instructions.hpp>
+#include <core/cpu.hpp>
+#include <memory/paging.hpp>
+#include <memory/tlb.hpp>
+
+namespace foros::memory
+{
+    /** IA32_PAT */
+    static constexpr const uint32_t pat_msr = 0x277;
+
+    namespace details
+    {
+        /** Encodings of the memory types in the PAT entries */
+        static constexpr const uint64_t pat_uncached = 0x00;
+        static constexpr const uint64_t pat_write_combining = 0x01;
+        static constexpr const uint64_t pat_write_through = 0x04;
+        static constexpr const uint64_t pat_write_protected = 0x05;
+        static constexpr const uint64_t pat_write_back = 0x06;
+        static constexpr const uint64_t pat_uncached_minus = 0x07;
+
+        static constexpr uint64_t pat_entry(std::size_t index, uint64_t type) noexcept
+        {
+            return type << (index * 8);
+        }
+    }
+
+    /**
+     * The PAT replaces the write-through entry selected by PWT alone with write-combining, so that every
+     * memory_type only needs PWT and PCD. The upper entries, only reachable with the PAT bit of 4KB entries,
+     * keep the other types available.
+     */
+    static constexpr const uint64_t pat_value =
+        details::pat_entry(static_cast<std::size_t>(memory_type::write_back), details::pat_write_back) |
+        details::pat_entry(static_cast<std::size_t>(memory_type::write_combining), details::pat_write_combining) |
+        details::pat_entry(static_cast<std::size_t>(memory_type::uncached_minus), details::pat_uncached_minus) |
+        details::pat_entry(static_cast<std::size_t>(memory_type::uncached), details::pat_uncached) |
+        details::pat_entry(4, details::pat_write_back) |
+        details::pat_entry(5, details::pat_write_protected) |
+        details::pat_entry(6, details::pat_uncached_minus) |
+        details::pat_entry(7, details::pat_write_through);
+
+    /**
+     * Program the page attribute table of the current CPU. Without PAT support, write_combining mappings fall
+     * back to write-through, which is slower but still correct.
+     *
+     * @return              if the PAT was programmed, true
+     *                      otherwise, false
+     */
+    inline bool initialize_pat() noexcept
+    {
+        namespace instr = x86_64::instructions;
+
+        if (!cpu_supports_pat()) {
+            return false;
+        }
+        /** Lines cached under the old types must not outlive the change, nor must TLB entries carrying them */
+        instr::wbinvd();
+        instr::wrmsr(pat_msr, pat_value);
+        instr::wbinvd();
+        flush_tlb_all();
+        return true;
+    }
+}
+
+#endif /* !FOROS_MEMORY_PAT_HPP */
@@ -5,12 +5,16 @@
 #ifndef FOROS_MEMORY_PHYSICAL_FRAME_HPP
 #define FOROS_MEMORY_PHYSICAL_FRAME_HPP
 
+#include <algorithm>
+#include <climits>
 #include <cstddef>
 #include <cstdint>
 #include <st/st.hpp>
 #include <utils/optional.hpp>
+#include <utils/span.hpp>
 #include <multiboot2/multiboot2.hpp>
 #include <memory/definitions.hpp>
+#include <memory/physical_regions.hpp>
 
 namespace mb2 = multiboot2;
 
@@ -24,6 +28,10 @@ namespace foros::memory
     {
         using st::type_base<std::size_t>::type_base;
 
+        physical_frame() noexcept : st::type_base<std::size_t>(0)
+        {
+        }
+
         static physical_frame for_address(physical_address addr) noexcept
         {
             return physical_frame(addr.value() / page_size);
@@ -36,24 +44,53 @@ namespace foros::memory
     };
 
     /**
-     * The physical frame allocator allocates physical frames from the mapped areas given by the multiboot information.
+     * The physical frame allocator allocates physical frames from the usable regions of physical memory.
      *
-     * Its logic is simple: it takes the frames in order from an area, and moves to the next when none are left.
-     * The only tricky part is that it has to avoid allocating frames that overlap with our kernel space or the
-     * multiboot information structure, since we don't want to overwrite them.
+     * It keeps one bit per physical frame (set if the frame is free) in a bitmap stored in physical memory.
+     * Allocating a frame means looking for the first non-zero 64-bit word of the bitmap and extracting its lowest
+     * set bit, so the cost of an allocation grows with the number of words rather than with the number of frames.
+     * The search only walks the words covering the regions of the physical region table, in which our kernel
+     * space, the multiboot information structure and the bitmap itself have already been clipped out.
      */
     class physical_frame_allocator
     {
     protected:
-        physical_frame_allocator(mb2::memory_area_iterator begin_it, mb2::memory_area_iterator end_it,
-                                 physical_address kernel_start, physical_address kernel_end,
-                                 physical_address multiboot_start, physical_address multiboot_end) noexcept :
-            _area_it(begin_it), _area_end_it(end_it),
-            _kernel_start(physical_frame::for_address(kernel_start)),
-            _kernel_end(physical_frame::for_address(kernel_end)),
-            _multiboot_start(physical_frame::for_address(multiboot_start)),
-            _multiboot_end(physical_frame::for_address(multiboot_end))
+        using word_type = uint64_t;
+
+        static constexpr const std::size_t frames_per_word = sizeof(word_type) * CHAR_BIT;
+
+        physical_frame_allocator(word_type *bitmap, const physical_region_table &regions) noexcept :
+            _bitmap(bitmap), _regions(regions), _frames_count(regions.end_frame()),
+            _words_count((_frames_count + frames_per_word - 1) / frames_per_word),
+            _free_frames(regions.frames_count())
+        {
+            for (std::size_t i = 0; i < _words_count; ++i) {
+                _bitmap[i] = 0;
+            }
+            for (const auto &region : _regions) {
+                _mark_range(region, true);
+            }
+        }
+
+        static std::size_t _bitmap_frames_count(std::size_t frames_count) noexcept
+        {
+            const auto bitmap_size = (frames_count + frames_per_word - 1) / frames_per_word * sizeof(word_type);
+
+            return (bitmap_size + page_size - 1) / page_size;
+        }
+
+        /** Find a place for the bitmap in a usable region of identity-mapped memory */
+        static utils::optional<physical_frame> _find_bitmap_storage(const physical_region_table &regions,
+                                                                    std::size_t frames_count) noexcept
         {
+            const auto identity_mapped_end = identity_mapped_size / page_size;
+
+            for (const auto &region : regions) {
+                if (region.start + frames_count <= std::min(region.end, identity_mapped_end)) {
+                    return {physical_frame(region.start)};
+                }
+            }
+            return std::nullopt;
         }
 
     public:
@@ -63,92 +100,243 @@ namespace foros::memory
          */
         static auto create(const mb2::boot_information &boot_info) noexcept
         {
-            auto memory_map = boot_info.tag<mb2::memory_map_tag>();
+            auto regions = physical_region_table::create(boot_info);
 
-            auto elf_sect_it = boot_info.tag<mb2::elf_sections_tag>().sections_begin();
-            auto elf_sect_end = boot_info.tag<mb2::elf_sections_tag>().sections_end();
+            /** The bitmap needs to cover every frame up to the end of the last usable region */
+            const auto bitmap_frames_count = _bitmap_frames_count(regions.end_frame());
+            auto bitmap_frame = _find_bitmap_storage(regions, bitmap_frames_count)
+                .unwrap_or_panic("physical_frame_allocator::create: unable to find room for the frame bitmap");
 
-            auto kernel_start = std::min_element(elf_sect_it, elf_sect_end, [](const mb2::elf_section &a,
-                                                                               const mb2::elf_section &b) {
-                return a.start_address() < b.start_address();
-            });
-            auto kernel_end = std::max_element(elf_sect_it, elf_sect_end, [](const mb2::elf_section &a,
-                                                                             const mb2::elf_section &b) {
-                return a.start_address() + a.size() < b.start_address() + b.size();
-            });
-
-            return physical_frame_allocator(memory_map.memory_areas_begin(), memory_map.memory_areas_end(),
-                                            physical_address(kernel_start->start_address()),
-                                            physical_address(kernel_end->end_address()),
-                                            physical_address(boot_info.start_address()),
-                                            physical_address(boot_info.end_address())
-            );
+            regions.reserve({bitmap_frame.value(), bitmap_frame.value() + bitmap_frames_count});
+            return physical_frame_allocator(reinterpret_cast<word_type *>(bitmap_frame.start_address().value()),
+                                            regions);
         }
 
     protected:
-        void _increment_area() noexcept
+        void _mark_range(frame_range range, bool free) noexcept
         {
-            for (auto cur_area_it = _area_it; cur_area_it != _area_end_it; ++cur_area_it) {
-                if (_area_it->start_address() < cur_area_it->start_address()) {
-                    /** If the area has not been used yet */
-                    auto start_addr = physical_address(cur_area_it->start_address());
+            auto frame = range.start;
+            const auto end = std::min(range.end, _frames_count);
 
-                    if (physical_frame::for_address(start_addr) >= _next_frame) {
-                        /** If the area comes before the last seen area (we process areas in order, so we want the first) */
-                        _area_it = cur_area_it;
-                        _next_frame = physical_frame::for_address(physical_address(_area_it->start_address()));
-                    }
+            while (frame < end) {
+                const auto bit = frame % frames_per_word;
+                const auto count = std::min(frames_per_word - bit, end - frame);
+                const auto mask = (count == frames_per_word ? ~word_type(0) : (word_type(1) << count) - 1) << bit;
+
+                if (free) {
+                    _bitmap[frame / frames_per_word] |= mask;
+                } else {
+                    _bitmap[frame / frames_per_word] &= ~mask;
                 }
+                frame += count;
+            }
+        }
+
+        /** Find the first frame in [frame, end) that is free (or not free), or end if there is none */
+        std::size_t _find_first(std::size_t frame, std::size_t end, bool free) const noexcept
+        {
+            while (frame < end) {
+                const auto bit = frame % frames_per_word;
+                const auto word = _bitmap[frame / frames_per_word];
+                const auto matching = (free ? word : ~word) >> bit;
 
+                if (matching != 0) {
+                    return std::min(frame + __builtin_ctzll(matching), end);
+                }
+                frame += frames_per_word - bit;
             }
-            _area_it = _area_end_it;
+            return end;
         }
 
     public:
         utils::optional<physical_frame> allocate_frame() noexcept
         {
-            while (true) {
-                /** Return nullopt if we cannot find any area to allocate from */
-                if (_area_it == _area_end_it)
-                    return std::nullopt;
-
-                auto candidate_frame = _next_frame;
-                auto last_byte_in_area_addr = physical_address(_area_it->start_address() + _area_it->size() - 1);
-                auto last_frame_in_current_area = physical_frame::for_address(last_byte_in_area_addr);
-
-                if (candidate_frame > last_frame_in_current_area) {
-                    /**
-                     * Our next frame is greater than the last one of the current area.
-                     * This means it would fall out of the area, so we need to find a new area to allocate from.
-                     */
-                    _increment_area();
-                    return allocate_frame();
-                } else if (_kernel_start <= candidate_frame && candidate_frame <= _kernel_end) {
-                    /** The frame is inside the kernel memory, skip it */
-                    _next_frame = _kernel_start + 1;
-                } else if (_multiboot_start <= candidate_frame && candidate_frame <= _multiboot_end) {
-                    /** The frame is inside the multiboot info memory, skip it */
-                    _next_frame = _multiboot_end + 1;
-                } else {
-                    _next_frame = _next_frame + 1;
-                    return candidate_frame;
+            /**
+             * Every word before the search hint is known to be full, and so is every region before the region
+             * hint, so start looking from there. Moving on to the next region skips the hole before it at once.
+             */
+            for (; _hint_region < _regions.size(); ++_hint_region) {
+                const auto &region = _regions[_hint_region];
+                const auto end_word = (region.end + frames_per_word - 1) / frames_per_word;
+
+                for (auto i = std::max(_search_hint, region.start / frames_per_word); i < end_word; ++i) {
+                    auto &word = _bitmap[i];
+
+                    if (word != 0) {
+                        const auto bit = static_cast<std::size_t>(__builtin_ctzll(word));
+
+                        /** Clear the lowest set bit */
+                        word &= word - 1;
+                        _search_hint = i;
+                        --_free_frames;
+                        return {physical_frame(i * frames_per_word + bit)};
+                    }
                 }
+                _search_hint = end_word;
             }
+            return std::nullopt;
+        }
+
+        /**
+         * Allocate a run of physically contiguous frames
+         *
+         * @param count         the number of frames to allocate
+         * @param alignment     the alignment of the first frame, in frames (must be a power of two)
+         *
+         * @return              on success, an optional containing the first frame of the run
+         *                      on failure, nullopt
+         */
+        utils::optional<physical_frame> allocate_contiguous_frames(std::size_t count,
+                                                                   std::size_t alignment = 1) noexcept
+        {
+            kassert(count > 0 && (alignment & (alignment - 1)) == 0,
+                    "physical_frame_allocator::allocate_contiguous_frames: invalid arguments");
+
+            for (const auto &region : _regions) {
+                auto first = (region.start + alignment - 1) & ~(alignment - 1);
+
+                while (first + count <= region.end) {
+                    const auto blocking = _find_first(first, first + count, false);
+
+                    if (blocking == first + count) {
+                        _mark_range({first, first + count}, false);
+                        _free_frames -= count;
+                        return {physical_frame(first)};
+                    }
+                    /** Restart from the next aligned frame following the one that is not available */
+                    first = (blocking + alignment) & ~(alignment - 1);
+                }
+            }
+            return std::nullopt;
+        }
+
+        /**
+         * Allocate consecutive frames, starting at the first free frame
+         *
+         * @param count         the maximum number of frames to allocate
+         *
+         * @return              the run of allocated frames, which is shorter than requested when the first free
+         *                      frame is not followed by enough free frames, and empty if no frame is left
+         */
+        frame_range allocate_run(std::size_t count) noexcept
+        {
+            kassert(count > 0, "physical_frame_allocator::allocate_run: invalid count");
+            auto first_opt = allocate_frame();
+
+            if (!first_opt) {
+                return {0, 0};
+            }
+
+            const auto first = first_opt.unwrap().value();
+            const auto end = _find_first(first + 1, std::min(first + count, _frames_count), false);
+
+            _mark_range({first + 1, end}, false);
+            _free_frames -= end - (first + 1);
+            return {first, end};
+        }
+
+        /**
+         * Allocate several frames at once, taking them by runs of consecutive frames when possible
+         *
+         * @param frames        the frames to fill
+         *
+         * @return              the number of frames allocated, which is lower than frames.size() only when
+         *                      running out of memory
+         */
+        std::size_t allocate_frames(utils::span<physical_frame> frames) noexcept
+        {
+            std::size_t filled = 0;
+
+            while (filled < frames.size()) {
+                const auto run = allocate_run(frames.size() - filled);
+
+                if (run.empty()) {
+                    break;
+                }
+                for (auto frame = run.start; frame < run.end; ++frame) {
+                    frames[filled++] = physical_frame(frame);
+                }
+            }
+            return filled;
+        }
+
+        /**
+         * Free a run of consecutive frames
+         *
+         * @param run           the run to free
+         */
+        void deallocate_run(frame_range run) noexcept
+        {
+            const auto region = _regions.index_of(run.start);
+
+            kassert(!run.empty() && region < _regions.size() && run.end <= _regions[region].end,
+                    "physical_frame_allocator::deallocate_run: run out of range");
+            kassert(_find_first(run.start, run.end, true) == run.end,
+                    "physical_frame_allocator::deallocate_run: run is already partially free");
+            _mark_range(run, true);
+            _free_frames += run.size();
+            if (run.start / frames_per_word < _search_hint) {
+                _search_hint = run.start / frames_per_word;
+                _hint_region = std::min(_hint_region, region);
+            }
+        }
+
+        void deallocate_frame(physical_frame frame) noexcept
+        {
+            const auto region = _regions.index_of(frame.value());
+
+            kassert(region < _regions.size(), "physical_frame_allocator::deallocate_frame: frame out of range");
+            const auto index = frame.value() / frames_per_word;
+            const auto mask = word_type(1) << (frame.value() % frames_per_word);
+
+            kassert((_bitmap[index] & mask) == 0, "physical_frame_allocator::deallocate_frame: frame is already free");
+            _bitmap[index] |= mask;
+            ++_free_frames;
+            if (index < _search_hint) {
+                _search_hint = index;
+                _hint_region = std::min(_hint_region, region);
+            }
+        }
+
+        /**
+         * Check whether a given frame is available for allocation
+         *
+         * @param frame         the frame
+         *
+         * @return              if the frame is free, true
+         *                      if the frame is allocated, reserved or out of range, false
+         */
+        bool is_frame_free(physical_frame frame) const noexcept
+        {
+            if (frame.value() >= _frames_count)
+                return false;
+            return (_bitmap[frame.value() / frames_per_word] >> (frame.value() % frames_per_word)) & 1;
+        }
+
+        std::size_t free_frames_count() const noexcept
+        {
+            return _free_frames;
+        }
+
+        std::size_t frames_count() const noexcept
+        {
+            return _frames_count;
         }
 
-        void deallocate_frame(physical_frame) noexcept
+        /** Get the table of the regions managed by this allocator */
+        const physical_region_table &regions() const noexcept
         {
-            /** No-op */
+            return _regions;
         }
 
     protected:
-        mb2::memory_area_iterator _area_it;
-        const mb2::memory_area_iterator _area_end_it;
-        physical_frame _next_frame{0};
-        const physical_frame _kernel_start;
-        const physical_frame _kernel_end;
-        const physical_frame _multiboot_start;
-        const physical_frame _multiboot_end;
+        word_type *_bitmap;
+        physical_region_table _regions;
+        std::size_t _frames_count;
+        std::size_t _words_count;
+        std::size_t _free_frames;
+        std::size_t _search_hint{0};
+        std::size_t _hint_region{0};
     };
 }
 
@@ -0,0 +1,229 @@
+/*
+** Created by doom on 18/10/26.
+*/
+
+#ifndef FOROS_MEMORY_PHYSICAL_REGIONS_HPP
+#define FOROS_MEMORY_PHYSICAL_REGIONS_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <core/panic.hpp>
+#include <multiboot2/multiboot2.hpp>
+#include <memory/definitions.hpp>
+
+namespace foros::memory
+{
+    /** A range of physical frames, given as frame numbers, from start (inclusive) to end (exclusive) */
+    struct frame_range
+    {
+        std::size_t start;
+        std::size_t end;
+
+        constexpr std::size_t size() const noexcept
+        {
+            return end - start;
+        }
+
+        constexpr bool empty() const noexcept
+        {
+            return start >= end;
+        }
+
+        constexpr bool contains(std::size_t frame) const noexcept
+        {
+            return start <= frame && frame < end;
+        }
+
+        constexpr bool overlaps(const frame_range &other) const noexcept
+        {
+            return start < other.end && other.start < end;
+        }
+    };
+
+    /**
+     * Table of the physical memory usable by the kernel.
+     *
+     * It is built once at boot from the multiboot memory map: only available areas are kept, shrunk to whole
+     * frames, sorted and merged when they touch. The kernel image and the multiboot information are then clipped
+     * out, so every frame of every region can be handed out without any further check.
+     */
+    class physical_region_table
+    {
+    public:
+        static constexpr const std::size_t max_regions = 32;
+
+        static physical_region_table create(const multiboot2::boot_information &boot_info) noexcept
+        {
+            namespace mb2 = multiboot2;
+
+            physical_region_table table;
+            auto memory_map = boot_info.tag<mb2::memory_map_tag>();
+
+            for (auto area_it = memory_map.memory_areas_begin(); area_it != memory_map.memory_areas_end(); ++area_it) {
+                if (area_it->is_available()) {
+                    /** Only frames lying entirely inside the area can be used */
+                    table._insert({((uintptr_t)area_it->start_address() + page_size - 1) / page_size,
+                                   (uintptr_t)area_it->end_address() / page_size});
+                }
+            }
+
+            auto elf_sect_it = boot_info.tag<mb2::elf_sections_tag>().sections_begin();
+            auto elf_sect_end = boot_info.tag<mb2::elf_sections_tag>().sections_end();
+
+            auto kernel_start = std::min_element(elf_sect_it, elf_sect_end, [](const mb2::elf_section &a,
+                                                                               const mb2::elf_section &b) {
+                return a.start_address() < b.start_address();
+            });
+            auto kernel_end = std::max_element(elf_sect_it, elf_sect_end, [](const mb2::elf_section &a,
+                                                                             const mb2::elf_section &b) {
+                return a.start_address() + a.size() < b.start_address() + b.size();
+            });
+
+            table.reserve(_frames_for(kernel_start->start_address(), kernel_end->end_address()));
+            table.reserve(_frames_for(boot_info.start_address(), boot_info.end_address()));
+            return table;
+        }
+
+        /**
+         * Remove a range of frames from the usable regions, splitting them if needed
+         *
+         * @param range         the range to remove
+         */
+        void reserve(frame_range range) noexcept
+        {
+            std::size_t i = 0;
+
+            while (i < _count) {
+                auto &region = _regions[i];
+
+                if (!region.overlaps(range)) {
+                    ++i;
+                } else if (range.start <= region.start && region.end <= range.end) {
+                    _erase(i);
+                } else if (region.start < range.start && range.end < region.end) {
+                    _insert_at(i + 1, {range.end, region.end});
+                    region.end = range.start;
+                    i += 2;
+                } else {
+                    if (range.start <= region.start) {
+                        region.start = range.end;
+                    } else {
+                        region.end = range.start;
+                    }
+                    ++i;
+                }
+            }
+        }
+
+        /**
+         * Find the region containing a given frame
+         *
+         * @param frame         the frame number
+         *
+         * @return              the index of the region containing the frame, or size() if there is none
+         */
+        std::size_t index_of(std::size_t frame) const noexcept
+        {
+            auto it = std::upper_bound(begin(), end(), frame, [](std::size_t f, const frame_range &region) {
+                return f < region.end;
+            });
+
+            if (it != end() && it->contains(frame)) {
+                return static_cast<std::size_t>(it - begin());
+            }
+            return size();
+        }
+
+        const frame_range &operator[](std::size_t index) const noexcept
+        {
+            kassert(index < _count, "physical_region_table::operator[]: index out of bounds");
+            return _regions[index];
+        }
+
+        const frame_range *begin() const noexcept
+        {
+            return _regions;
+        }
+
+        const frame_range *end() const noexcept
+        {
+            return _regions + _count;
+        }
+
+        std::size_t size() const noexcept
+        {
+            return _count;
+        }
+
+        /** Get the frame following the last usable one */
+        std::size_t end_frame() const noexcept
+        {
+            return _count == 0 ? 0 : _regions[_count - 1].end;
+        }
+
+        /** Get the total number of usable frames */
+        std::size_t frames_count() const noexcept
+        {
+            std::size_t total = 0;
+
+            for (const auto &region : *this) {
+                total += region.size();
+            }
+            return total;
+        }
+
+    private:
+        static frame_range _frames_for(const std::byte *start, const std::byte *end) noexcept
+        {
+            /** Any frame touched by the range is considered part of it, including the one holding its end address */
+            return {(uintptr_t)start / page_size, (uintptr_t)end / page_size + 1};
+        }
+
+        /** Insert a region, keeping the table sorted and merging the regions that touch */
+        void _insert(frame_range range) noexcept
+        {
+            if (range.empty()) {
+                return;
+            }
+
+            std::size_t i = 0;
+            while (i < _count && _regions[i].end < range.start) {
+                ++i;
+            }
+            if (i < _count && _regions[i].start <= range.end) {
+                _regions[i].start = std::min(_regions[i].start, range.start);
+                _regions[i].end = std::max(_regions[i].end, range.end);
+                while (i + 1 < _count && _regions[i + 1].start <= _regions[i].end) {
+                    _regions[i].end = std::max(_regions[i].end, _regions[i + 1].end);
+                    _erase(i + 1);
+                }
+            } else {
+                _insert_at(i, range);
+            }
+        }
+
+        void _insert_at(std::size_t index, frame_range range) noexcept
+        {
+            kassert(_count < max_regions, "physical_region_table: too many memory regions");
+            for (auto i = _count; i > index; --i) {
+                _regions[i] = _regions[i - 1];
+            }
+            _regions[index] = range;
+            ++_count;
+        }
+
+        void _erase(std::size_t index) noexcept
+        {
+            for (auto i = index; i + 1 < _count; ++i) {
+                _regions[i] = _regions[i + 1];
+            }
+            --_count;
+        }
+
+        frame_range _regions[max_regions];
+        std::size_t _count{0};
+    };
+}
+
+#endif /* !FOROS_MEMORY_PHYSICAL_REGIONS_HPP */
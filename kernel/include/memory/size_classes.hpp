@@ -0,0 +1,95 @@
+/*
+** Created by doom on 18/10/26.
+*/
+
+#ifndef FOROS_MEMORY_SIZE_CLASSES_HPP
+#define FOROS_MEMORY_SIZE_CLASSES_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+namespace foros::memory
+{
+    /**
+     * Sizes of the objects handed out by the slabs of the kernel heap: powers of two, and the sizes halfway
+     * between them, so that rounding a request up never wastes more than a third of the object.
+     */
+    static constexpr const std::size_t size_classes[] = {
+        16, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024, 1536, 2048, 3072, 4096, 6144, 8192,
+    };
+
+    static constexpr const std::size_t size_classes_count = sizeof(size_classes) / sizeof(size_classes[0]);
+
+    /** Larger allocations are made of whole pages */
+    static constexpr const std::size_t max_small_size = size_classes[size_classes_count - 1];
+
+    /**
+     * Get the alignment of the objects of a size class, which is the largest power of two dividing its size
+     *
+     * @param size          the size of the class
+     *
+     * @return              the alignment
+     */
+    constexpr std::size_t size_class_alignment(std::size_t size) noexcept
+    {
+        return size & (~size + 1);
+    }
+
+    namespace details
+    {
+        /** Smallest alignment of a size class, for which no search is needed */
+        static constexpr const std::size_t size_class_granule = 16;
+
+        /** Index of the size class of each multiple of the granule, so that common requests need no search */
+        struct size_class_table
+        {
+            constexpr size_class_table() noexcept : indexes()
+            {
+                std::size_t index = 0;
+
+                for (std::size_t i = 0; i <= max_small_size / size_class_granule; ++i) {
+                    while (size_classes[index] < i * size_class_granule) {
+                        ++index;
+                    }
+                    indexes[i] = static_cast<uint8_t>(index);
+                }
+            }
+
+            uint8_t indexes[max_small_size / size_class_granule + 1];
+        };
+
+        static constexpr const size_class_table size_class_lookup{};
+    }
+
+    /**
+     * Find the smallest size class able to hold an allocation
+     *
+     * @param size          the size of the allocation
+     * @param align         the alignment of the allocation
+     *
+     * @return              the index of the size class, or size_classes_count if the allocation has to be made
+     *                      of whole pages
+     */
+    constexpr std::size_t size_class_for(std::size_t size, std::size_t align) noexcept
+    {
+        if (size > max_small_size) {
+            return size_classes_count;
+        }
+
+        auto index = static_cast<std::size_t>(details::size_class_lookup.indexes[
+            (size + details::size_class_granule - 1) / details::size_class_granule]);
+
+        /** Over-aligned requests move up to the first class whose objects are aligned enough */
+        while (index < size_classes_count && size_class_alignment(size_classes[index]) < align) {
+            ++index;
+        }
+        return index;
+    }
+
+    static_assert(size_class_for(1, 1) == 0 && size_class_for(17, 8) == 1 && size_class_for(40, 64) == 3 &&
+                  size_class_for(max_small_size, 16) == size_classes_count - 1 &&
+                  size_class_for(max_small_size + 1, 16) == size_classes_count,
+                  "size classes lookup is broken");
+}
+
+#endif /* !FOROS_MEMORY_SIZE_CLASSES_HPP */
@@ -0,0 +1,186 @@
+/*
+** Created by doom on 18/10/26.
+*/
+
+#ifndef FOROS_MEMORY_SLAB_HPP
+#define FOROS_MEMORY_SLAB_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <core/panic.hpp>
+#include <memory/definitions.hpp>
+
+namespace foros::memory
+{
+    /**
+     * A slab is a page, or a few contiguous pages for large objects, cut into objects of a single size.
+     *
+     * Its header sits at its start, and slabs are aligned on their size, so the slab owning an object is found
+     * by rounding the address of the object down to the size of the slab. Free objects are chained through one
+     * of their words (the first one, unless their state has to survive while they are free), which makes
+     * allocating and freeing an object a push or a pop. Slabs with free objects are linked together by their
+     * owner, through the prev and next pointers of their header.
+     */
+    struct slab
+    {
+        slab *prev;
+        slab *next;
+        void *free_list;
+        uint32_t object_size;
+        uint16_t capacity;
+        uint16_t in_use;
+        /** Identifies the owner of the slab, such as a size class */
+        uint32_t owner;
+        /** Offset of the first object from the start of the page */
+        uint16_t first_offset;
+        /** Offset inside a free object of the link to the next one, past the object if its state must be kept */
+        uint16_t link_offset;
+
+        /**
+         * Turn a page into an empty slab
+         *
+         * @param page          the start of the page
+         * @param object_size   the size of the objects, at least the size of a pointer
+         * @param align         the alignment of the objects, a power of two
+         * @param color         an extra offset for the first object, so that slabs do not all put their objects
+         *                      on the same cache sets
+         * @param owner         the owner of the slab
+         * @param link_offset   where free objects keep the link to the next one
+         * @param slab_size     the size of the slab, a power of two of pages to which the slab is aligned
+         *
+         * @return              the slab
+         */
+        static slab *create(void *page, std::size_t object_size, std::size_t align, std::size_t color,
+                            uint32_t owner, std::size_t link_offset = 0, std::size_t slab_size = page_size) noexcept
+        {
+            kassert(reinterpret_cast<uintptr_t>(page) % slab_size == 0 &&
+                    link_offset + sizeof(void *) <= object_size && link_offset % alignof(void *) == 0,
+                    "slab::create: invalid page or object size");
+            const auto first = first_offset_for(align, color);
+
+            kassert(first + object_size <= slab_size, "slab::create: objects do not fit in the slab");
+            auto *s = new (page) slab{nullptr, nullptr, nullptr, static_cast<uint32_t>(object_size),
+                                      static_cast<uint16_t>((slab_size - first) / object_size), 0, owner,
+                                      static_cast<uint16_t>(first), static_cast<uint16_t>(link_offset)};
+
+            /** Chain the objects in address order, so that the first allocations are contiguous */
+            for (auto i = s->capacity; i > 0; --i) {
+                void *obj = s->object_at(i - 1u);
+
+                s->_link(obj) = s->free_list;
+                s->free_list = obj;
+            }
+            return s;
+        }
+
+        /**
+         * Get the offset of the first object of a slab from the start of its page
+         *
+         * @param align         the alignment of the objects
+         * @param color         the color of the slab
+         *
+         * @return              the offset
+         */
+        static constexpr std::size_t first_offset_for(std::size_t align, std::size_t color) noexcept
+        {
+            return (sizeof(slab) + color + align - 1) & ~(align - 1);
+        }
+
+        /**
+         * Get the slab holding an object
+         *
+         * @param ptr           the object
+         * @param slab_size     the size of the slab
+         *
+         * @return              the slab
+         */
+        static slab *of(const void *ptr, std::size_t slab_size = page_size) noexcept
+        {
+            return reinterpret_cast<slab *>(reinterpret_cast<uintptr_t>(ptr) & ~(slab_size - 1));
+        }
+
+        void *object_at(std::size_t index) noexcept
+        {
+            return reinterpret_cast<std::byte *>(this) + first_offset + index * object_size;
+        }
+
+        /** Take a free object, the slab must not be full */
+        void *pop() noexcept
+        {
+            void *obj = free_list;
+
+            free_list = _link(obj);
+            ++in_use;
+            return obj;
+        }
+
+        /** Give an object back */
+        void push(void *obj) noexcept
+        {
+            _link(obj) = free_list;
+            free_list = obj;
+            --in_use;
+        }
+
+        bool full() const noexcept
+        {
+            return free_list == nullptr;
+        }
+
+        bool empty() const noexcept
+        {
+            return in_use == 0;
+        }
+
+    private:
+        void *&_link(void *obj) const noexcept
+        {
+            return *reinterpret_cast<void **>(static_cast<std::byte *>(obj) + link_offset);
+        }
+    };
+
+    /** An intrusive list of slabs, linked through their headers */
+    class slab_list
+    {
+    public:
+        slab *front() const noexcept
+        {
+            return _head;
+        }
+
+        bool empty() const noexcept
+        {
+            return _head == nullptr;
+        }
+
+        void push_front(slab *s) noexcept
+        {
+            s->prev = nullptr;
+            s->next = _head;
+            if (_head != nullptr) {
+                _head->prev = s;
+            }
+            _head = s;
+        }
+
+        void remove(slab *s) noexcept
+        {
+            if (s->prev != nullptr) {
+                s->prev->next = s->next;
+            } else {
+                _head = s->next;
+            }
+            if (s->next != nullptr) {
+                s->next->prev = s->prev;
+            }
+            s->prev = nullptr;
+            s->next = nullptr;
+        }
+
+    private:
+        slab *_head{nullptr};
+    };
+}
+
+#endif /* !FOROS_MEMORY_SLAB_HPP */
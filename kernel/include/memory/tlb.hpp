@@ -0,0 +1,190 @@
+/*
+** Created by doom on 18/10/26.
+*/
+
+#ifndef FOROS_MEMORY_TLB_HPP
+#define FOROS_MEMORY_TLB_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <arch/x86_64/instructions.hpp>
+#include <arch/x86_64/registers.hpp>
+#include <core/panic.hpp>
+#include <memory/definitions.hpp>
+#include <memory/physical_frame.hpp>
+
+namespace foros::memory
+{
+    namespace arch = ::foros::x86_64;
+
+    /** CR4.PGE: when set, global pages survive CR3 reloads */
+    static constexpr const uintptr_t cr4_global_pages = 1 << 7;
+
+    /**
+     * Flush the whole TLB of the current CPU, including global pages
+     */
+    inline void flush_tlb_all() noexcept
+    {
+        const auto cr4 = arch::registers::cr4();
+
+        if (cr4 & cr4_global_pages) {
+            /** Toggling CR4.PGE invalidates every entry, global ones included */
+            arch::registers::set_cr4(cr4 & ~cr4_global_pages);
+            arch::registers::set_cr4(cr4);
+        } else {
+            arch::registers::set_cr3(arch::registers::cr3());
+        }
+    }
+
+    /**
+     * Collects the TLB invalidations required by a set of page table updates, to apply them all at once.
+     *
+     * Pages are invalidated one by one with invlpg as long as there are fewer of them than the threshold. Past it,
+     * the batch falls back to a single full flush, which is cheaper than hundreds of invlpg and does not need to
+     * remember the pages. Pending invalidations are applied when the batch is flushed or destroyed.
+     * The pending addresses can be read back, so that the same batch can be sent to other CPUs for a shootdown.
+     *
+     * Invalidations only reach the TLB entries tagged with the current PCID (and global ones), so flushing kernel
+     * addresses bumps a generation counter telling the other address spaces that their entries are stale.
+     *
+     * Frames which were mapped by the pages of the batch are only given back once the batch is flushed, so that
+     * they cannot be reused while a stale TLB entry still points to them.
+     */
+    class tlb_flush_batch
+    {
+    public:
+        static constexpr const std::size_t max_pending = 64;
+        static constexpr const std::size_t default_threshold = 32;
+
+        /** Number of frames waiting for the flush to be freed, past which the batch is flushed early */
+        static constexpr const std::size_t max_deferred_frees = 64;
+
+        explicit tlb_flush_batch(std::size_t threshold = default_threshold) noexcept : _threshold(threshold)
+        {
+            kassert(threshold <= max_pending, "tlb_flush_batch: threshold is too high");
+        }
+
+        tlb_flush_batch(const tlb_flush_batch &) = delete;
+
+        tlb_flush_batch &operator=(const tlb_flush_batch &) = delete;
+
+        ~tlb_flush_batch() noexcept
+        {
+            flush();
+        }
+
+        /**
+         * Schedule the invalidation of a page
+         *
+         * @param addr          an address inside the page (for huge pages, any address in them will do)
+         * @param global        whether the page was mapped as global, which a CR3 reload does not flush
+         */
+        void add(virtual_address addr, bool global = false) noexcept
+        {
+            _has_global = _has_global || global;
+            _has_kernel = _has_kernel || is_kernel_p4_index((addr.value() >> 39) & 0x1ff);
+            if (_full_flush) {
+                return;
+            }
+            if (_count == _threshold) {
+                _full_flush = true;
+                return;
+            }
+            _pending[_count++] = addr.value();
+        }
+
+        /**
+         * Give a frame back to its allocator once the pending invalidations are applied
+         *
+         * @param frame         the frame, which must not be mapped by any page outside of the batch anymore
+         * @param al            the allocator of the frame, the same one for every frame of the batch
+         */
+        template <typename FrameAllocator>
+        void defer_free(physical_frame frame, FrameAllocator &al) noexcept
+        {
+            kassert(_deferred_count == 0 || _deferred_allocator == &al,
+                    "tlb_flush_batch::defer_free: frames of a batch must go back to a single allocator");
+            if (_deferred_count == max_deferred_frees) {
+                flush();
+            }
+            _deferred_allocator = &al;
+            _deferred_release = [](void *allocator, physical_frame f) {
+                static_cast<FrameAllocator *>(allocator)->deallocate_frame(f);
+            };
+            _deferred[_deferred_count++] = frame;
+        }
+
+        /**
+         * Apply the pending invalidations, then free the frames which were waiting for them
+         */
+        void flush() noexcept
+        {
+            if (_full_flush) {
+                if (_has_global) {
+                    flush_tlb_all();
+                } else {
+                    arch::registers::set_cr3(arch::registers::cr3());
+                }
+            } else {
+                for (std::size_t i = 0; i < _count; ++i) {
+                    arch::instructions::invlpg(_pending[i]);
+                }
+            }
+            if (_has_kernel) {
+                ++_kernel_generation;
+            }
+            _count = 0;
+            _full_flush = false;
+            _has_global = false;
+            _has_kernel = false;
+            for (std::size_t i = 0; i < _deferred_count; ++i) {
+                _deferred_release(_deferred_allocator, _deferred[i]);
+            }
+            _deferred_count = 0;
+        }
+
+        /** Get the number of flushes that invalidated kernel pages so far */
+        static std::size_t kernel_generation() noexcept
+        {
+            return _kernel_generation;
+        }
+
+        /** Check whether the batch will flush the whole TLB instead of single pages */
+        bool needs_full_flush() const noexcept
+        {
+            return _full_flush;
+        }
+
+        /** Get the addresses of the pages pending invalidation, only meaningful without a full flush */
+        const uintptr_t *begin() const noexcept
+        {
+            return _pending;
+        }
+
+        const uintptr_t *end() const noexcept
+        {
+            return _pending + _count;
+        }
+
+        std::size_t size() const noexcept
+        {
+            return _count;
+        }
+
+    private:
+        std::size_t _threshold;
+        uintptr_t _pending[max_pending]{};
+        std::size_t _count{0};
+        bool _full_flush{false};
+        bool _has_global{false};
+        bool _has_kernel{false};
+        physical_frame _deferred[max_deferred_frees]{};
+        std::size_t _deferred_count{0};
+        void *_deferred_allocator{nullptr};
+        void (*_deferred_release)(void *, physical_frame){nullptr};
+
+        static inline std::size_t _kernel_generation{0};
+    };
+}
+
+#endif /* !FOROS_MEMORY_TLB_HPP */
@@ -0,0 +1,94 @@
+/*
+** Created by doom on 18/10/26.
+*/
+
+#ifndef FOROS_MEMORY_TRANSLATION_CACHE_HPP
+#define FOROS_MEMORY_TRANSLATION_CACHE_HPP
+
+#include <cstddef>
+#include <core/compiler_hints.hpp>
+#include <utils/optional.hpp>
+#include <utils/singleton.hpp>
+#include <memory/physical_frame.hpp>
+
+namespace foros::memory
+{
+    /**
+     * Direct-mapped cache of page to frame translations, in front of the page table walks of the mapper.
+     *
+     * Each page number has a single slot, so a lookup is one compare. Only successful translations are cached,
+     * and the mapper invalidates the slot of every page it maps or unmaps. Switching address spaces invalidates
+     * the whole cache at once by bumping its generation, which every slot has to match to be valid.
+     */
+    class translation_cache : public utils::singleton<translation_cache>
+    {
+    public:
+        static constexpr const std::size_t capacity = 256;
+
+        struct statistics
+        {
+            std::size_t hits;
+            std::size_t misses;
+        };
+
+        /**
+         * Look for the translation of a page
+         *
+         * @param page_number   the page number
+         *
+         * @return              on hit, an optional containing the frame
+         *                      on miss, nullopt
+         */
+        utils::optional<physical_frame> lookup(std::size_t page_number) noexcept
+        {
+            const auto &slot = _slots[page_number % capacity];
+
+            if likely(slot.generation == _generation && slot.page_number == page_number) {
+                ++_stats.hits;
+                return {slot.frame};
+            }
+            ++_stats.misses;
+            return std::nullopt;
+        }
+
+        void insert(std::size_t page_number, physical_frame frame) noexcept
+        {
+            _slots[page_number % capacity] = {page_number, frame, _generation};
+        }
+
+        void invalidate(std::size_t page_number) noexcept
+        {
+            auto &slot = _slots[page_number % capacity];
+
+            if (slot.page_number == page_number) {
+                slot.generation = 0;
+            }
+        }
+
+        /** Drop every cached translation, for instance when switching address spaces */
+        void invalidate_all() noexcept
+        {
+            ++_generation;
+        }
+
+        const statistics &stats() const noexcept
+        {
+            return _stats;
+        }
+
+    private:
+        struct slot
+        {
+            std::size_t page_number;
+            physical_frame frame;
+            /** 0 is never a valid generation, so that zero-initialized slots are empty */
+            std::size_t generation;
+        };
+
+        slot _slots[capacity]{};
+        std::size_t _generation{1};
+        statistics _stats{};
+    };
+}
+
+#endif /* !FOROS_MEMORY_TRANSLATION_CACHE_HPP */
@@ -0,0 +1,341 @@
+/*
+** Created by doom on 18/10/26.
+*/
+
+#ifndef FOROS_MEMORY_VIRTUAL_RANGE_ALLOCATOR_HPP
+#define FOROS_MEMORY_VIRTUAL_RANGE_ALLOCATOR_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <core/panic.hpp>
+#include <utils/optional.hpp>
+#include <memory/definitions.hpp>
+#include <memory/paging.hpp>
+
+namespace foros::memory
+{
+    /**
+     * Hands out ranges of kernel virtual addresses from a fixed area.
+     *
+     * The free ranges are kept in a table sorted by address, and merged as soon as they touch, so freeing a range
+     * coalesces it with its neighbours. Allocations are first-fit.
+     * Free ranges are separated by allocated ones, so there is at most one more of them than live ranges. The
+     * table starts inline, and allocate() grows it through a table allocator ahead of the live ranges, so that
+     * freeing a range always finds a slot and never fails. Every range is followed by unmapped guard pages,
+     * so that overflowing a buffer or a stack faults instead of silently corrupting the next range.
+     * Allocating only reserves addresses: allocate_mapped() also backs them with frames through the mapper.
+     */
+    class virtual_range_allocator
+    {
+    public:
+        /** Capacity of the inline table, used until a table allocator is set and the table has to grow */
+        static constexpr const std::size_t max_free_ranges = 128;
+        static constexpr const std::size_t default_guard_pages = 1;
+
+        /** Functions with which the table of free ranges grows, such as the ones of the kernel heap */
+        using table_allocate_fn = void *(*)(std::size_t size) noexcept;
+        using table_free_fn = void (*)(void *ptr, std::size_t size) noexcept;
+
+        /**
+         * @param start         the start of the area, aligned on a page
+         * @param end           the end of the area, aligned on a page
+         * @param guard_pages   the number of unmapped pages following each range
+         */
+        virtual_range_allocator(virtual_address start, virtual_address end,
+                                std::size_t guard_pages = default_guard_pages) noexcept : _guard_pages(guard_pages)
+        {
+            kassert(start.value() % page_size == 0 && end.value() % page_size == 0 && start.value() < end.value(),
+                    "virtual_range_allocator: invalid area");
+            /** The first range also gets guard pages below it */
+            _free[0] = {start.value() / page_size + guard_pages, end.value() / page_size};
+            _count = 1;
+        }
+
+        virtual_range_allocator(const virtual_range_allocator &) = delete;
+
+        virtual_range_allocator &operator=(const virtual_range_allocator &) = delete;
+
+        ~virtual_range_allocator() noexcept
+        {
+            if (_free != _inline_free) {
+                _table_free(_free, _capacity * sizeof(range));
+            }
+        }
+
+        /**
+         * Let the table of free ranges grow beyond max_free_ranges
+         *
+         * @param allocate_fn   the function allocating the table
+         * @param free_fn       the function freeing the table
+         */
+        void set_table_allocator(table_allocate_fn allocate_fn, table_free_fn free_fn) noexcept
+        {
+            _table_allocate = allocate_fn;
+            _table_free = free_fn;
+        }
+
+        /**
+         * Reserve a range of virtual addresses
+         *
+         * @param size          the size of the range, in bytes
+         * @param align         the alignment of the range, a power of two multiple of the page size
+         *
+         * @return              on success, an optional containing the start of the range
+         *                      on failure (no free range is large enough), nullopt
+         */
+        utils::optional<virtual_address> allocate(std::size_t size, std::size_t align = page_size) noexcept
+        {
+            kassert(size > 0 && align % page_size == 0 && (align & (align - 1)) == 0,
+                    "virtual_range_allocator::allocate: invalid size or alignment");
+            const auto pages_count = _pages_for(size);
+            const auto align_pages = align / page_size;
+
+            /** A new range may split a free one, and its free may not merge, so keep a slot for each */
+            if (!_reserve_slots(_live_ranges + 2)) {
+                return std::nullopt;
+            }
+            for (std::size_t i = 0; i < _count; ++i) {
+                auto &r = _free[i];
+                const auto first = (r.first + align_pages - 1) & ~(align_pages - 1);
+                const auto end = first + pages_count + _guard_pages;
+
+                if (end > r.end || end < first) {
+                    continue;
+                }
+                if (first == r.first) {
+                    r.first = end;
+                    if (r.first == r.end) {
+                        _erase(i);
+                    }
+                } else if (end == r.end) {
+                    r.end = first;
+                } else {
+                    _insert_at(i + 1, {end, r.end});
+                    _free[i].end = first;
+                }
+                _allocated_pages += pages_count;
+                ++_live_ranges;
+                return {virtual_address(first * page_size)};
+            }
+            return std::nullopt;
+        }
+
+        /**
+         * Give back a range of virtual addresses, along with its guard pages
+         *
+         * @param start         the start of the range, as returned by allocate()
+         * @param size          the size of the range, as given to allocate()
+         */
+        void free(virtual_address start, std::size_t size) noexcept
+        {
+            kassert(start.value() % page_size == 0, "virtual_range_allocator::free: misaligned range");
+            const auto pages_count = _pages_for(size);
+            const range freed{start.value() / page_size, start.value() / page_size + pages_count + _guard_pages};
+            auto it = std::upper_bound(_free, _free + _count, freed.first, [](std::size_t first, const range &r) {
+                return first < r.first;
+            });
+            const auto index = static_cast<std::size_t>(it - _free);
+            const bool merges_prev = index > 0 && _free[index - 1].end == freed.first;
+            const bool merges_next = index < _count && freed.end == _free[index].first;
+
+            kassert((index == 0 || _free[index - 1].end <= freed.first) && (index == _count || freed.end <= it->first),
+                    "virtual_range_allocator::free: range is not allocated");
+            if (merges_prev && merges_next) {
+                _free[index - 1].end = _free[index].end;
+                _erase(index);
+            } else if (merges_prev) {
+                _free[index - 1].end = freed.end;
+            } else if (merges_next) {
+                _free[index].first = freed.first;
+            } else {
+                _insert_at(index, freed);
+            }
+            _allocated_pages -= pages_count;
+            --_live_ranges;
+        }
+
+        /**
+         * Reserve a range of virtual addresses and map it to newly allocated frames
+         *
+         * @param size          the size of the range, in bytes
+         * @param entry_flags   the flags to apply to the pages
+         * @param al            the physical allocator used to allocate the frames and page tables
+         * @param align         the alignment of the range, a power of two multiple of the page size
+         *
+         * @return              on success, an optional containing the start of the range
+         *                      on failure, nullopt
+         */
+        template <typename FrameAllocator>
+        utils::optional<virtual_address> allocate_mapped(std::size_t size, page_table_entry::flags entry_flags,
+                                                         FrameAllocator &al, std::size_t align = page_size) noexcept
+        {
+            auto start_opt = allocate(size, align);
+
+            if (start_opt) {
+                mapper::map_range(page::for_address(start_opt.unwrap()), _pages_for(size), entry_flags, al);
+            }
+            return start_opt;
+        }
+
+        /**
+         * Reserve a range of virtual addresses and map it to existing physical memory, such as a framebuffer or
+         * device registers. The memory must not be mapped anywhere else with another memory type, so RAM from the
+         * frame allocator, which is direct-mapped, cannot be used. Windows are removed with unmap_physical().
+         *
+         * @param start         the physical address of the memory, aligned on a page
+         * @param size          the size of the memory, in bytes
+         * @param type          the memory type to use, such as memory_type::write_combining for a framebuffer
+         * @param al            the physical allocator used to allocate page tables
+         *
+         * @return              on success, an optional containing the start of the window
+         *                      on failure, nullopt
+         */
+        template <typename FrameAllocator>
+        utils::optional<virtual_address> map_physical(physical_address start, std::size_t size, memory_type type,
+                                                      FrameAllocator &al) noexcept
+        {
+            kassert(start.value() % page_size == 0, "virtual_range_allocator::map_physical: misaligned memory");
+            auto window_opt = allocate(size);
+
+            if (window_opt) {
+                const auto first_frame = start.value() / page_size;
+
+                mapper::map_range(page::for_address(window_opt.unwrap()),
+                                  frame_range{first_frame, first_frame + _pages_for(size)},
+                                  page_table_entry::flags::writable | page_table_entry::flags::global |
+                                  page_table_entry::memory_type_flags(type), al);
+            }
+            return window_opt;
+        }
+
+        /**
+         * Unmap a window returned by map_physical(), then give it back. The physical memory is left alone.
+         *
+         * @param start         the start of the window
+         * @param size          the size of the window, as given to map_physical()
+         * @param al            the physical allocator to which the page tables are given back
+         */
+        template <typename FrameAllocator>
+        void unmap_physical(virtual_address start, std::size_t size, FrameAllocator &al) noexcept
+        {
+            mapper::unmap_physical_range(page::for_address(start), _pages_for(size), al);
+            free(start, size);
+        }
+
+        /**
+         * Unmap a range returned by allocate_mapped(), then give it back
+         *
+         * @param start         the start of the range
+         * @param size          the size of the range, as given to allocate_mapped()
+         * @param al            the physical allocator to which the frames are given back
+         */
+        template <typename FrameAllocator>
+        void free_mapped(virtual_address start, std::size_t size, FrameAllocator &al) noexcept
+        {
+            mapper::unmap_range(page::for_address(start), _pages_for(size), al);
+            free(start, size);
+        }
+
+        /** Get the number of pages handed out, guard pages excluded */
+        std::size_t allocated_pages_count() const noexcept
+        {
+            return _allocated_pages;
+        }
+
+        /** Get the number of free ranges, which tells how fragmented the area is */
+        std::size_t free_ranges_count() const noexcept
+        {
+            return _count;
+        }
+
+        /** Get the size in pages of the largest free range */
+        std::size_t largest_free_range() const noexcept
+        {
+            std::size_t largest = 0;
+
+            for (std::size_t i = 0; i < _count; ++i) {
+                largest = std::max(largest, _free[i].end - _free[i].first);
+            }
+            return largest;
+        }
+
+        std::size_t guard_pages() const noexcept
+        {
+            return _guard_pages;
+        }
+
+    private:
+        /** A range of pages, given as page numbers */
+        struct range
+        {
+            std::size_t first;
+            std::size_t end;
+        };
+
+        static constexpr std::size_t _pages_for(std::size_t size) noexcept
+        {
+            return (size + page_size - 1) / page_size;
+        }
+
+        /**
+         * Make sure the table has room for a number of free ranges, growing it if it is about to run out
+         *
+         * @param slots         the number of free ranges needed
+         *
+         * @return              if the table has room for them, true
+         *                      otherwise, false
+         */
+        bool _reserve_slots(std::size_t slots) noexcept
+        {
+            /**
+             * Grow with a little room to spare: allocating the new table may reserve a range from this allocator,
+             * which then finds the old table large enough
+             */
+            if (slots + 2 > _capacity && _table_allocate != nullptr && !_growing) {
+                _growing = true;
+                auto *table = static_cast<range *>(_table_allocate(2 * _capacity * sizeof(range)));
+                _growing = false;
+
+                if (table != nullptr) {
+                    auto *old_table = _free;
+                    const auto old_capacity = _capacity;
+
+                    std::copy(_free, _free + _count, table);
+                    _free = table;
+                    _capacity = 2 * old_capacity;
+                    if (old_table != _inline_free) {
+                        _table_free(old_table, old_capacity * sizeof(range));
+                    }
+                }
+            }
+            return slots <= _capacity;
+        }
+
+        void _insert_at(std::size_t index, range r) noexcept
+        {
+            kassert(_count < _capacity, "virtual_range_allocator: free range table is full");
+            std::move_backward(_free + index, _free + _count, _free + _count + 1);
+            _free[index] = r;
+            ++_count;
+        }
+
+        void _erase(std::size_t index) noexcept
+        {
+            std::move(_free + index + 1, _free + _count, _free + index);
+            --_count;
+        }
+
+        range _inline_free[max_free_ranges];
+        range *_free{_inline_free};
+        std::size_t _capacity{max_free_ranges};
+        std::size_t _count{0};
+        std::size_t _live_ranges{0};
+        table_allocate_fn _table_allocate{nullptr};
+        table_free_fn _table_free{nullptr};
+        bool _growing{false};
+        std::size_t _guard_pages;
+        std::size_t _allocated_pages{0};
+    };
+}
+
+#endif /* !FOROS_MEMORY_VIRTUAL_RANGE_ALLOCATOR_HPP */
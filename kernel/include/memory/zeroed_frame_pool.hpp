@@ -0,0 +1,174 @@
+/*
+** Created by doom on 18/10/26.
+*/
+
+#ifndef FOROS_MEMORY_ZEROED_FRAME_POOL_HPP
+#define FOROS_MEMORY_ZEROED_FRAME_POOL_HPP
+
+#include <cstddef>
+#include <arch/x86_64/instructions.hpp>
+#include <core/compiler_hints.hpp>
+#include <interrupts/maskable_interrupts.hpp>
+#include <utils/optional.hpp>
+#include <memory/definitions.hpp>
+#include <memory/physical_frame.hpp>
+#include <memory/frame_cache.hpp>
+
+namespace foros::memory
+{
+    /**
+     * Check whether a frame can be accessed through the direct map
+     *
+     * @param frame         the frame
+     *
+     * @return              if the frame is direct-mapped, true
+     *                      otherwise, false
+     */
+    inline bool is_direct_mapped(physical_frame frame) noexcept
+    {
+        return is_direct_mapped(frame.start_address(), page_size);
+    }
+
+    /**
+     * Fill a frame with zeros
+     *
+     * @param frame         the frame, which has to be direct-mapped
+     */
+    inline void zero_frame(physical_frame frame) noexcept
+    {
+        kassert(is_direct_mapped(frame), "zero_frame: frame is not direct-mapped");
+        x86_64::instructions::rep_stosq(reinterpret_cast<void *>(phys_to_virt(frame.start_address()).value()), 0,
+                                        page_size / sizeof(uint64_t));
+    }
+
+    /**
+     * Pool of frames zeroed ahead of time, in front of the per-CPU frame cache.
+     *
+     * The pool is refilled by the idle loop, so that callers asking for zeroed frames (such as new page tables)
+     * don't have to pay for the zeroing. When the pool is empty, the frame is zeroed inline instead.
+     * Plain frame allocations and frees go straight to the frame cache, so the pool can be given to the mapper as
+     * a frame allocator.
+     *
+     * The page fault handler takes zeroed frames while the idle loop may be refilling the pool, so the pool is
+     * only updated with maskable interrupts ignored. Frames are zeroed with interrupts enabled, before they are
+     * published in the pool.
+     */
+    class zeroed_frame_pool
+    {
+    public:
+        static constexpr const std::size_t capacity = 64;
+
+        /** Maximum number of frames zeroed by a single call to refill(), to keep idle work short */
+        static constexpr const std::size_t refill_batch = 8;
+
+        struct statistics
+        {
+            /** Zeroed frames taken from the pool */
+            std::size_t hits;
+            /** Zeroed frames that had to be zeroed inline */
+            std::size_t misses;
+
+            std::size_t hit_rate_percent() const noexcept
+            {
+                return hits + misses == 0 ? 0 : hits * 100 / (hits + misses);
+            }
+        };
+
+        explicit zeroed_frame_pool(per_cpu_frame_cache &source) noexcept : _source(&source)
+        {
+        }
+
+        utils::optional<physical_frame> allocate_frame() noexcept
+        {
+            return _source->allocate_frame();
+        }
+
+        void deallocate_frame(physical_frame frame) noexcept
+        {
+            _source->deallocate_frame(frame);
+        }
+
+        /**
+         * Allocate a frame filled with zeros
+         *
+         * @return              on success, an optional containing the frame
+         *                      on failure, nullopt
+         */
+        utils::optional<physical_frame> allocate_zeroed_frame() noexcept
+        {
+            {
+                maskable_interrupts_guard guard;
+
+                if likely(_count > 0) {
+                    ++_stats.hits;
+                    return {_frames[--_count]};
+                }
+                ++_stats.misses;
+            }
+
+            auto frame_opt = _source->allocate_frame();
+
+            if (frame_opt) {
+                zero_frame(frame_opt.unwrap());
+            }
+            return frame_opt;
+        }
+
+        /**
+         * Zero a few frames ahead of time
+         *
+         * @return              if the pool is full, true
+         *                      if there is more work to do, false
+         */
+        bool refill() noexcept
+        {
+            for (std::size_t i = 0; i < refill_batch && _count < capacity; ++i) {
+                auto frame_opt = _source->allocate_frame();
+
+                if (!frame_opt) {
+                    break;
+                }
+
+                auto frame = frame_opt.unwrap();
+                if (!is_direct_mapped(frame)) {
+                    _source->deallocate_frame(frame);
+                    break;
+                }
+                zero_frame(frame);
+
+                maskable_interrupts_guard guard;
+                /** Interrupts only take frames from the pool, so there is still room for this one */
+                _frames[_count++] = frame;
+            }
+            return _count == capacity;
+        }
+
+        /** Give every frame of the pool back to the frame cache, when memory runs low */
+        void drain() noexcept
+        {
+            maskable_interrupts_guard guard;
+
+            while (_count > 0) {
+                _source->deallocate_frame(_frames[--_count]);
+            }
+        }
+
+        std::size_t size() const noexcept
+        {
+            return _count;
+        }
+
+        const statistics &stats() const noexcept
+        {
+            return _stats;
+        }
+
+    private:
+        per_cpu_frame_cache *_source;
+        physical_frame _frames[capacity];
+        std::size_t _count{0};
+        statistics _stats{};
+    };
+}
+
+#endif /* !FOROS_MEMORY_ZEROED_FRAME_POOL_HPP */
@@ -44,17 +44,17 @@ namespace multiboot2
 
         bool is_available() const noexcept
         {
-            return static_cast<int>(type() & memory_type::memory_available) != 0;
+            return type() == memory_type::memory_available;
         }
 
         bool is_reserved() const noexcept
         {
-            return static_cast<int>(type() & memory_type::reserved) != 0;
+            return type() == memory_type::reserved;
         }
 
         bool is_acpi_reclaimable() const noexcept
         {
-            return static_cast<int>(type() & memory_type::acpi_reclaimable) != 0;
+            return type() == memory_type::acpi_reclaimable;
         }
 
     private:
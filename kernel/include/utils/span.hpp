@@ -0,0 +1,79 @@
+/*
+** Created by doom on 18/10/26.
+*/
+
+#ifndef FOROS_UTILS_SPAN_HPP
+#define FOROS_UTILS_SPAN_HPP
+
+#include <cstddef>
+
+namespace utils
+{
+    /** Non-owning view over a contiguous sequence of objects */
+    template <typename T>
+    class span
+    {
+    public:
+        using element_type = T;
+        using iterator = T *;
+
+        constexpr span() noexcept : _data(nullptr), _size(0)
+        {
+        }
+
+        constexpr span(T *data, std::size_t size) noexcept : _data(data), _size(size)
+        {
+        }
+
+        template <std::size_t N>
+        constexpr span(T (&arr)[N]) noexcept : _data(arr), _size(N)
+        {
+        }
+
+        constexpr T *data() const noexcept
+        {
+            return _data;
+        }
+
+        constexpr std::size_t size() const noexcept
+        {
+            return _size;
+        }
+
+        constexpr bool empty() const noexcept
+        {
+            return _size == 0;
+        }
+
+        constexpr T &operator[](std::size_t index) const noexcept
+        {
+            return _data[index];
+        }
+
+        constexpr iterator begin() const noexcept
+        {
+            return _data;
+        }
+
+        constexpr iterator end() const noexcept
+        {
+            return _data + _size;
+        }
+
+        constexpr span subspan(std::size_t offset, std::size_t count) const noexcept
+        {
+            return span(_data + offset, count);
+        }
+
+        constexpr span subspan(std::size_t offset) const noexcept
+        {
+            return span(_data + offset, _size - offset);
+        }
+
+    private:
+        T *_data;
+        std::size_t _size;
+    };
+}
+
+#endif /* !FOROS_UTILS_SPAN_HPP */
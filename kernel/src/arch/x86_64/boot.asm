@@ -133,7 +133,7 @@ setup_page_tables:
 .map_2mb_page:
 	mov eax, 0x200000		; Size of a page
 	mul ecx				; We multiply by the number of added pages
-	or eax, 0b10000011		; Present = 1, Writable = 1 << 1, Huge = 1 << 7
+	or eax, 0b110000011		; Present = 1, Writable = 1 << 1, Huge = 1 << 7, Global = 1 << 8
 	mov [p2_table + ecx * 8], eax	; Add to the page
 
 	inc ecx
@@ -161,8 +161,9 @@ enable_paging:
 
 	; Add the Physical Address Extension to CR4
 	; https://en.wikipedia.org/wiki/Physical_Address_Extension
+	; Also enable global pages, so that the kernel mappings survive CR3 reloads
 	mov eax, cr4
-	or eax, 1 << 5
+	or eax, 1 << 5 | 1 << 7
 	mov cr4, eax
 
 	; Set the long mode bit in the EFER MSR (model specific register)
@@ -8,6 +8,8 @@
 #include <interrupts/exceptions.hpp>
 #include <interrupts/pic.hpp>
 #include <keyboard/key_event_recognizer.hpp>
+#include <memory/demand_paging.hpp>
+#include <memory/kernel_heap.hpp>
 #include <stdarg.h>
 
 /**
@@ -198,9 +200,17 @@ define_handler_with_error_code(handle_double_fault)(const exception_stack_frame
 define_handler_with_error_code(handle_page_fault)(const exception_stack_frame *stack_frame, uint64_t err_code)
 {
     const auto error_code = page_fault_error_code(err_code);
+    const auto fault_addr = memory::virtual_address(arch::registers::cr2());
+
+    /** Accesses to pages that are not present yet may belong to a region backed on demand */
+    if ((error_code & page_fault_error_code::protection_violation) == page_fault_error_code::none &&
+        memory::demand_paged_regions::instance().handle_fault(fault_addr,
+                                                              memory::kernel_heap::instance().zeroed_frames())) {
+        return;
+    }
 
     vga::scrolling_printer() << "Page fault when accessing address: " << vga::text_color(vga::cyan)
-                             << (void *)arch::registers::cr2() << vga::text_color(vga::white) << '\n';
+                             << (void *)fault_addr.value() << vga::text_color(vga::white) << '\n';
     vga::scrolling_printer() << "error code: " << error_code << '\n';
     vga::scrolling_printer() << "stack frame: " << *stack_frame << '\n';
     panic("Page fault detected");
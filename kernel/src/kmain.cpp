@@ -9,7 +9,9 @@
 #include <interrupts/handlers.hpp>
 #include <multiboot2/multiboot2.hpp>
 #include <interrupts/interrupts.hpp>
+#include <memory/address_space.hpp>
 #include <memory/kernel_heap.hpp>
+#include <memory/pat.hpp>
 
 using namespace foros;
 using namespace vga::literals;
@@ -40,9 +42,9 @@ static void setup_idt() noexcept
 static void setup_memory(const mb2::boot_information &boot_info) noexcept
 {
     vga::scrolling_printer() << "Setting up the kernel heap... ";
-    memory::kernel_heap::instance().initialize(boot_info,
-                                               memory::virtual_address(0x40000000),
-                                               memory::virtual_address(0x40020000));
+    memory::initialize_pat();
+    memory::kernel_heap::instance().initialize(boot_info);
+    memory::address_space::initialize();
     vga::scrolling_printer() << "Done\n";
 }
 
@@ -0,0 +1,162 @@
+/*
+** Created by doom on 18/10/26.
+*/
+
+#include <algorithm>
+#include <memory/heap_profiler.hpp>
+#include <vga/scrolling_printer.hpp>
+
+namespace foros::memory
+{
+    void heap_profiler::reset() noexcept
+    {
+        std::fill(std::begin(_sites), std::end(_sites), site{});
+        std::fill(std::begin(_samples), std::end(_samples), sample{});
+        std::fill(std::begin(_page_samples), std::end(_page_samples), 0);
+        _sites_count = 0;
+        _live_samples = 0;
+        _dropped_samples = 0;
+    }
+
+    void heap_profiler::record_allocation(void *ptr, void *return_addr, void *frame) noexcept
+    {
+        /** The sample weighs every byte allocated since the previous one, so the totals are exact */
+        const auto weight = static_cast<std::size_t>(_armed_bytes - _bytes_until_sample);
+
+        if (!_enabled) {
+            _bytes_until_sample = disabled_countdown;
+            return;
+        }
+        _arm();
+
+        void *frames[max_frames]{};
+        _capture(return_addr, frame, frames);
+
+        const auto site_index = _site_for(frames);
+        const auto slot = _sample_slot(ptr);
+        if (site_index == max_sites || _live_samples + 1 >= max_samples || _samples[slot].ptr != nullptr) {
+            ++_dropped_samples;
+            return;
+        }
+
+        auto &s = _sites[site_index];
+        s.live_bytes += weight;
+        s.allocated_bytes += weight;
+        ++s.samples;
+        _samples[slot] = sample{ptr, weight, site_index};
+        ++_page_samples[_filter_slot(ptr)];
+        ++_live_samples;
+    }
+
+    const heap_profiler::site *heap_profiler::find_site(const void *ptr) const noexcept
+    {
+        const auto &slot = _samples[_sample_slot(ptr)];
+
+        return slot.ptr == nullptr ? nullptr : &_sites[slot.site];
+    }
+
+    void heap_profiler::dump(std::size_t count) const noexcept
+    {
+        auto &printer = vga::scrolling_printer();
+        uint16_t order[max_sites];
+
+        for (std::size_t i = 0; i < _sites_count; ++i) {
+            order[i] = static_cast<uint16_t>(i);
+        }
+        count = std::min(count, _sites_count);
+        std::partial_sort(order, order + count, order + _sites_count, [this](uint16_t a, uint16_t b) {
+            return _sites[a].live_bytes > _sites[b].live_bytes;
+        });
+
+        printer << "Heap profile: " << _live_samples << " live samples, " << _dropped_samples << " dropped, "
+                << _sites_count << " sites\n";
+        for (std::size_t i = 0; i < count; ++i) {
+            const auto &s = _sites[order[i]];
+
+            if (s.live_bytes == 0) {
+                break;
+            }
+            printer << "  " << s.live_bytes << " live, " << s.allocated_bytes << " allocated:";
+            for (std::size_t f = 0; f < max_frames && s.frames[f] != nullptr; ++f) {
+                printer << ' ' << s.frames[f];
+            }
+            printer << '\n';
+        }
+    }
+
+    void heap_profiler::_capture(void *return_addr, [[maybe_unused]] void *frame,
+                                 void *(&frames)[max_frames]) const noexcept
+    {
+        frames[0] = return_addr;
+#ifdef FOROS_HEAP_PROFILER_BACKTRACE
+        /** Each frame starts with the frame pointer of its caller, followed by the return address into it */
+        auto fp = reinterpret_cast<uintptr_t>(frame);
+
+        for (std::size_t i = 1; i < max_frames; ++i) {
+            const auto next = *reinterpret_cast<const uintptr_t *>(fp);
+
+            if (next <= fp || next - fp > max_frame_distance || next % alignof(uintptr_t) != 0) {
+                break;
+            }
+            fp = next;
+            frames[i] = reinterpret_cast<void *const *>(fp)[1];
+        }
+#endif
+    }
+
+    uint16_t heap_profiler::_site_for(void *const (&frames)[max_frames]) noexcept
+    {
+        for (std::size_t i = 0; i < _sites_count; ++i) {
+            if (std::equal(std::begin(frames), std::end(frames), std::begin(_sites[i].frames))) {
+                return static_cast<uint16_t>(i);
+            }
+        }
+        if (_sites_count == max_sites) {
+            return max_sites;
+        }
+        std::copy(std::begin(frames), std::end(frames), std::begin(_sites[_sites_count].frames));
+        return static_cast<uint16_t>(_sites_count++);
+    }
+
+    std::size_t heap_profiler::_home_slot(const void *ptr) noexcept
+    {
+        const auto hash = (reinterpret_cast<uintptr_t>(ptr) >> 4) * 0x9e3779b97f4a7c15;
+
+        return static_cast<std::size_t>(hash >> 32) & (max_samples - 1);
+    }
+
+    std::size_t heap_profiler::_sample_slot(const void *ptr) const noexcept
+    {
+        constexpr const std::size_t mask = max_samples - 1;
+        auto slot = _home_slot(ptr);
+
+        while (_samples[slot].ptr != nullptr && _samples[slot].ptr != ptr) {
+            slot = (slot + 1) & mask;
+        }
+        return slot;
+    }
+
+    void heap_profiler::_forget(void *ptr) noexcept
+    {
+        constexpr const std::size_t mask = max_samples - 1;
+        auto hole = _sample_slot(ptr);
+
+        if (_samples[hole].ptr == nullptr) {
+            return;
+        }
+        _sites[_samples[hole].site].live_bytes -= _samples[hole].weight;
+        --_page_samples[_filter_slot(ptr)];
+        --_live_samples;
+
+        /** Shift back the following samples of the probe sequence, so that lookups never need tombstones */
+        for (auto slot = (hole + 1) & mask; _samples[slot].ptr != nullptr; slot = (slot + 1) & mask) {
+            const auto home = _home_slot(_samples[slot].ptr);
+
+            if (((slot - home) & mask) >= ((slot - hole) & mask)) {
+                _samples[hole] = _samples[slot];
+                hole = slot;
+            }
+        }
+        _samples[hole] = sample{};
+    }
+}
@@ -2,55 +2,409 @@
 ** Created by doom on 10/11/18.
 */
 
+#include <algorithm>
+#include <core/compiler_hints.hpp>
+#include <core/idle.hpp>
+#include <memory/direct_map.hpp>
 #include <memory/kernel_heap.hpp>
 #include <memory/paging.hpp>
 #include <vga/scrolling_printer.hpp>
 
 namespace foros::memory
 {
-    void kernel_heap::initialize(const multiboot2::boot_information &boot_info,
-                                 virtual_address start_address,
-                                 virtual_address end_address) noexcept
+    /** Number of 4MB blocks reserved at boot for physically contiguous allocations */
+    static constexpr const std::size_t contiguous_pool_blocks = 4;
+
+    void kernel_heap::initialize(const multiboot2::boot_information &boot_info) noexcept
     {
-        _start_addr = start_address;
-        _end_addr = end_address;
-        _current_addr = start_address;
         _frame_allocator.emplace(physical_frame_allocator::create(boot_info));
+        _frame_database.emplace(frame_database::create(*_frame_allocator)
+                                    .unwrap_or_panic("kernel_heap::initialize: unable to create the frame database"));
+        _buddy_allocator.emplace(buddy_frame_allocator::create(*_frame_allocator, contiguous_pool_blocks)
+                                     .unwrap_or_panic("kernel_heap::initialize: unable to create the buddy allocator"));
+        _frame_database->assign(_buddy_allocator->pool(), frame_owner::contiguous);
+        mapper::track_page_tables(*_frame_database);
+        _frame_cache.emplace(*_frame_allocator);
+        _zeroed_frames.emplace(*_frame_cache);
+        build_direct_map(_frame_allocator->regions(), *_zeroed_frames);
+        mapper::preallocate_kernel_tables(*_zeroed_frames);
+        _virtual_ranges.emplace(virtual_address(kernel_ranges_start), virtual_address(kernel_ranges_end));
+        idle_tasks::instance().add([]() {
+            kernel_heap::instance().zeroed_frames().refill();
+        });
+
+        _start_addr = _virtual_ranges->allocate(area_size, chunk_size)
+            .unwrap_or_panic("kernel_heap::initialize: unable to reserve the heap area");
+        _end_addr = _start_addr + area_size;
+        for (std::size_t i = 0; i < initial_chunks; ++i) {
+            const bool mapped = _grow();
+
+            kassert(mapped, "kernel_heap::initialize: unable to map the heap area");
+        }
+        /** Now that the heap works, the table of free virtual ranges can grow in it */
+        _virtual_ranges->set_table_allocator([](std::size_t size) noexcept {
+            return kernel_heap::instance().allocate(size);
+        }, [](void *ptr, std::size_t size) noexcept {
+            kernel_heap::instance().deallocate(ptr, size);
+        });
+    }
+
+    void *kernel_heap::allocate(size_t size, size_t align) noexcept
+    {
+        return allocate(size, align, __builtin_return_address(0), __builtin_frame_address(0));
+    }
 
-        if (start_address != end_address) {
-            auto end_page = page::for_address(virtual_address(end_address.value() - 1));
-            auto next_page = [](page p) {
-                return page::for_address(virtual_address(p.start_address() + page_size));
-            };
+    void *kernel_heap::allocate(size_t size, size_t align, void *return_addr, void *frame) noexcept
+    {
+        const auto class_index = size_class_for(size, align);
+        void *ptr = likely(class_index < size_classes_count) ? _allocate_small(class_index) :
+                    _allocate_large(size, align);
 
-            for (auto page = page::for_address(start_address); page != end_page; page = next_page(page)) {
-                mapper::map_page(page, page_table_entry::flags::writable, *_frame_allocator);
+        if likely(ptr != nullptr) {
+            _record_allocation(size, align, class_index);
+            if unlikely(_profiler.should_sample(size)) {
+                _profiler.record_allocation(ptr, return_addr, frame);
             }
+        } else {
+            ++_stats.failed_allocations;
         }
+        return ptr;
     }
 
-    static virtual_address align_up(virtual_address base, size_t align)
+    void kernel_heap::deallocate(void *ptr, std::size_t size, std::size_t align) noexcept
     {
-        return virtual_address((base.value() + (align - 1)) & ~(align - 1));
+        if (ptr == nullptr) {
+            return;
+        }
+        _profiler.record_deallocation(ptr);
+        if likely(_in_heap_area(ptr)) {
+            const auto class_index = _deallocate_small(ptr);
+
+            _record_deallocation(size, _alignment_bytes(size, align, class_index), class_index);
+        } else {
+            const auto recorded_size = _deallocate_large(ptr);
+
+            kassert(_held_bytes(size, size_classes_count) == _held_bytes(recorded_size, size_classes_count),
+                    "kernel_heap::deallocate: size does not match the allocation");
+            _record_deallocation(recorded_size, 0, size_classes_count);
+        }
     }
 
-    void *kernel_heap::allocate(size_t size, size_t align) noexcept
+    void kernel_heap::deallocate(void *ptr) noexcept
+    {
+        if (ptr == nullptr) {
+            return;
+        }
+        _profiler.record_deallocation(ptr);
+        if likely(_in_heap_area(ptr)) {
+            /** An object allocated with its rounded size has no rounding, even when it was over-aligned */
+            const auto size = _slab_of(ptr)->object_size;
+
+            _record_deallocation(size, 0, _deallocate_small(ptr));
+        } else {
+            _record_deallocation(_deallocate_large(ptr), 0, size_classes_count);
+        }
+    }
+
+    std::size_t kernel_heap::allocation_size(const void *ptr) const noexcept
+    {
+        if likely(_in_heap_area(ptr)) {
+            const auto *s = _slab_of(ptr);
+
+            kassert(s->owner < size_classes_count, "kernel_heap::allocation_size: pointer does not come from the heap");
+            return s->object_size;
+        }
+
+        const auto *record = _find_large_allocation(reinterpret_cast<uintptr_t>(ptr));
+
+        kassert(record != nullptr, "kernel_heap::allocation_size: pointer does not come from the heap");
+        return _held_bytes(record->size, size_classes_count);
+    }
+
+    void kernel_heap::dump_statistics() const noexcept
+    {
+        auto &printer = vga::scrolling_printer();
+
+        printer << "Kernel heap: " << _stats.allocations << " allocations, " << _stats.deallocations << " frees, "
+                << _stats.failed_allocations << " failures\n";
+        printer << "  live: " << _stats.live_bytes << " bytes (peak " << _stats.peak_live_bytes << "), rounding: "
+                << _stats.rounding_bytes << " bytes (alignment " << _stats.alignment_bytes << ")\n";
+        printer << "  slab pages: " << _used_pages << " of " << _mapped_chunks * chunk_pages << " mapped, large: "
+                << _stats.live_large_allocations << " allocations in " << _stats.live_large_pages << " pages\n";
+        printer << "  fragmentation: " << fragmentation_percent() << "%\n";
+        printer << "  live objects per class:";
+        for (std::size_t i = 0; i < size_classes_count; ++i) {
+            printer << ' ' << size_classes[i] << ':' << _stats.class_live_objects[i];
+        }
+        printer << "\n  requests per size:";
+        for (std::size_t i = 0; i < size_histogram_buckets; ++i) {
+            if (_stats.size_histogram[i] != 0) {
+                printer << " <=" << (std::size_t(1) << (i + 4)) << ':' << _stats.size_histogram[i];
+            }
+        }
+        printer << '\n';
+    }
+
+    std::size_t kernel_heap::_alignment_bytes(std::size_t size, std::size_t align, std::size_t class_index) noexcept
+    {
+        if (class_index == size_classes_count || align <= details::size_class_granule) {
+            return 0;
+        }
+        return size_classes[class_index] - size_classes[size_class_for(size, details::size_class_granule)];
+    }
+
+    void kernel_heap::_record_allocation(std::size_t size, std::size_t align, std::size_t class_index) noexcept
+    {
+        const auto bucket = size <= 16 ? 0 : std::min<std::size_t>(64 - __builtin_clzll(size - 1) - 4,
+                                                                     size_histogram_buckets - 1);
+
+        ++_stats.allocations;
+        ++_stats.size_histogram[bucket];
+        _stats.live_bytes += size;
+        _stats.peak_live_bytes = std::max(_stats.peak_live_bytes, _stats.live_bytes);
+        _stats.rounding_bytes += _held_bytes(size, class_index) - size;
+        const auto alignment_bytes = _alignment_bytes(size, align, class_index);
+
+        _stats.alignment_bytes += alignment_bytes;
+        if (class_index < size_classes_count) {
+            ++_stats.class_allocations[class_index];
+            ++_stats.class_live_objects[class_index];
+        } else {
+            ++_stats.live_large_allocations;
+            _stats.live_large_pages += _held_bytes(size, class_index) / page_size;
+        }
+    }
+
+    void kernel_heap::_record_deallocation(std::size_t size, std::size_t alignment_bytes,
+                                           std::size_t class_index) noexcept
+    {
+        ++_stats.deallocations;
+        _stats.live_bytes -= size;
+        _stats.rounding_bytes -= _held_bytes(size, class_index) - size;
+        _stats.alignment_bytes -= alignment_bytes;
+        if (class_index < size_classes_count) {
+            --_stats.class_live_objects[class_index];
+        } else {
+            --_stats.live_large_allocations;
+            _stats.live_large_pages -= _held_bytes(size, class_index) / page_size;
+        }
+    }
+
+    void *kernel_heap::_allocate_small(std::size_t class_index) noexcept
+    {
+        auto &partial = _partial_slabs[class_index];
+
+        if unlikely(partial.empty()) {
+            const auto object_size = size_classes[class_index];
+            const auto slab_size = object_size <= max_page_slab_size ? page_size : chunk_size;
+            void *start = slab_size == page_size ? allocate_page() : _allocate_chunk();
+
+            if (start == nullptr) {
+                return nullptr;
+            }
+            partial.push_front(slab::create(start, object_size, size_class_alignment(object_size), 0,
+                                            static_cast<uint32_t>(class_index), 0, slab_size));
+        }
+
+        auto *s = partial.front();
+        void *ptr = s->pop();
+
+        if (s->full()) {
+            partial.remove(s);
+        }
+        return ptr;
+    }
+
+    std::size_t kernel_heap::_deallocate_small(void *ptr) noexcept
+    {
+        auto *s = _slab_of(ptr);
+        const auto class_index = static_cast<std::size_t>(s->owner);
+
+        kassert(class_index < size_classes_count, "kernel_heap::deallocate: pointer does not come from the heap");
+        auto &partial = _partial_slabs[class_index];
+        const bool was_full = s->full();
+
+        s->push(ptr);
+        if (was_full) {
+            partial.push_front(s);
+        } else if (s->empty() && (partial.front() != s || s->next != nullptr)) {
+            /** Keep the last slab of the class around, so that a single object going back and forth is cheap */
+            partial.remove(s);
+            if (s->object_size <= max_page_slab_size) {
+                free_page(s);
+            } else {
+                _free_chunk(s);
+            }
+        }
+        return class_index;
+    }
+
+    void *kernel_heap::_allocate_large(std::size_t size, std::size_t align) noexcept
     {
-        virtual_address ret = align_up(_current_addr, align);
+        auto *record = static_cast<large_allocation *>(_allocate_small(large_allocation_class));
+
+        if (record == nullptr) {
+            return nullptr;
+        }
 
-        _current_addr = ret + size;
-        if (_current_addr >= _end_addr) {
+        const auto entry_flags = page_table_entry::flags::writable | page_table_entry::flags::global;
+        auto addr_opt = _virtual_ranges->allocate_mapped(size, entry_flags, *_zeroed_frames,
+                                                         std::max(align, page_size));
+
+        if (!addr_opt) {
+            _deallocate_small(record);
             return nullptr;
         }
-        return (void *)ret.value();
+
+        record->start = addr_opt.unwrap().value();
+        record->size = size;
+        auto &bucket = _large_allocations[_large_allocation_bucket(record->start)];
+        record->next = bucket;
+        bucket = record;
+        return reinterpret_cast<void *>(record->start);
     }
 
-    void kernel_heap::deallocate(void *ptr, std::size_t size, std::size_t) noexcept
+    std::size_t kernel_heap::_deallocate_large(void *ptr) noexcept
     {
-        auto addr = virtual_address((uintptr_t)ptr);
+        auto **link = _large_allocation_link(reinterpret_cast<uintptr_t>(ptr));
+        auto *record = *link;
+
+        kassert(record != nullptr, "kernel_heap::deallocate: pointer does not come from the heap");
+        *link = record->next;
+
+        const auto size = record->size;
+        _deallocate_small(record);
+        _virtual_ranges->free_mapped(virtual_address(reinterpret_cast<uintptr_t>(ptr)), size, *_zeroed_frames);
+        return size;
+    }
 
-        if (addr + size == _current_addr) {
-            _current_addr = virtual_address(_current_addr.value() - size);
+    void *kernel_heap::allocate_page() noexcept
+    {
+        if (_free_pages == nullptr && !_grow()) {
+            return nullptr;
         }
+
+        auto *page = _free_pages;
+        _remove_free_page(page);
+        --_chunk_free_pages[_chunk_of(page)];
+        ++_used_pages;
+        return page;
     }
-}
\ No newline at end of file
+
+    void kernel_heap::free_page(void *page) noexcept
+    {
+        const auto chunk = _chunk_of(page);
+
+        --_used_pages;
+        _push_free_page(static_cast<free_page_link *>(page));
+        if (++_chunk_free_pages[chunk] == chunk_pages && chunk >= initial_chunks) {
+            _shrink(chunk);
+        }
+    }
+
+    void kernel_heap::_push_free_page(free_page_link *page) noexcept
+    {
+        page->prev = nullptr;
+        page->next = _free_pages;
+        if (_free_pages != nullptr) {
+            _free_pages->prev = page;
+        }
+        _free_pages = page;
+    }
+
+    void kernel_heap::_remove_free_page(free_page_link *page) noexcept
+    {
+        if (page->prev != nullptr) {
+            page->prev->next = page->next;
+        } else {
+            _free_pages = page->next;
+        }
+        if (page->next != nullptr) {
+            page->next->prev = page->prev;
+        }
+    }
+
+    /** Back one more chunk of the heap area with physical memory, and make its pages available */
+    bool kernel_heap::_grow() noexcept
+    {
+        if (_unmapped_chunks_count == 0 && _next_chunk == max_chunks) {
+            return false;
+        }
+        if (_frame_allocator->free_frames_count() < chunk_pages) {
+            /** Frames parked in the zeroed pool and the magazines are free as well */
+            _zeroed_frames->drain();
+            _frame_cache->flush();
+            if (_frame_allocator->free_frames_count() < chunk_pages) {
+                return false;
+            }
+        }
+
+        const auto chunk = _unmapped_chunks_count > 0 ? _unmapped_chunks[--_unmapped_chunks_count] : _next_chunk++;
+        const auto first_page = page::for_address(_chunk_address(chunk));
+        std::size_t done = 0;
+
+        /** Take the frames by runs, so that most chunks are backed by a single call to the allocator */
+        while (done < chunk_pages) {
+            const auto run = _frame_allocator->allocate_run(chunk_pages - done);
+
+            kassert(!run.empty(), "kernel_heap::_grow: unable to allocate physical frames");
+            mapper::map_range(page(first_page.value() + done), run,
+                              page_table_entry::flags::writable | page_table_entry::flags::global, *_zeroed_frames);
+            _frame_database->assign(run, frame_owner::heap);
+            done += run.size();
+        }
+        for (std::size_t i = chunk_pages; i > 0; --i) {
+            const auto p = page(first_page.value() + i - 1);
+
+            _push_free_page(reinterpret_cast<free_page_link *>(p.start_address().value()));
+        }
+        _chunk_free_pages[chunk] = chunk_pages;
+        ++_mapped_chunks;
+        return true;
+    }
+
+    /** Give the frames of an entirely free chunk back, keeping its addresses for a later _grow() */
+    void kernel_heap::_shrink(std::size_t chunk) noexcept
+    {
+        const auto first_page = page::for_address(_chunk_address(chunk));
+
+        for (std::size_t i = 0; i < chunk_pages; ++i) {
+            const auto p = page(first_page.value() + i);
+
+            _remove_free_page(reinterpret_cast<free_page_link *>(p.start_address().value()));
+            _frame_database->release(mapper::get_frame_for_page(p).unwrap());
+        }
+        mapper::unmap_range(first_page, chunk_pages, *_zeroed_frames);
+        _chunk_free_pages[chunk] = 0;
+        _unmapped_chunks[_unmapped_chunks_count++] = static_cast<uint16_t>(chunk);
+        --_mapped_chunks;
+    }
+
+    void *kernel_heap::_allocate_chunk() noexcept
+    {
+        /** Pages are freed and mapped in order, so an entirely free chunk is usually at the head of the list */
+        if ((_free_pages == nullptr || _chunk_free_pages[_chunk_of(_free_pages)] != chunk_pages) && !_grow()) {
+            return nullptr;
+        }
+
+        const auto chunk = _chunk_of(_free_pages);
+        const auto start = _chunk_address(chunk);
+
+        for (std::size_t i = 0; i < chunk_pages; ++i) {
+            _remove_free_page(reinterpret_cast<free_page_link *>((start + i * page_size).value()));
+        }
+        _chunk_free_pages[chunk] = 0;
+        _slab_chunks[chunk] = true;
+        _used_pages += chunk_pages;
+        return reinterpret_cast<void *>(start.value());
+    }
+
+    void kernel_heap::_free_chunk(void *start) noexcept
+    {
+        _slab_chunks[_chunk_of(start)] = false;
+        for (std::size_t i = 0; i < chunk_pages; ++i) {
+            free_page(static_cast<std::byte *>(start) + i * page_size);
+        }
+    }
+
+}
@@ -0,0 +1,161 @@
+/*
+** Created by doom on 18/10/26.
+*/
+
+#include <cstddef>
+#include <new>
+#include <core/compiler_hints.hpp>
+#include <core/panic.hpp>
+#include <memory/kernel_heap.hpp>
+
+/**
+ * Global allocation functions, so that plain new expressions and over-aligned types reach the kernel heap.
+ *
+ * Objects are allocated with their requested size, so that the heap statistics measure the rounding, and freed
+ * with it, as deletes of complete types are sized. Arrays of trivial types are freed without their size, so arrays
+ * are allocated and freed with their rounded size instead, which the heap finds back on its own.
+ */
+
+namespace
+{
+    using foros::memory::kernel_heap;
+
+    /** Always inlined, so that the heap profiler sees the callers of operator new */
+    force_inline void *allocate(std::size_t size, std::size_t align) noexcept
+    {
+        return kernel_heap::instance().allocate(size, align, __builtin_return_address(0), __builtin_frame_address(0));
+    }
+
+    force_inline void *allocate_or_panic(std::size_t size, std::size_t align) noexcept
+    {
+        void *ptr = allocate(size, align);
+
+        if unlikely(ptr == nullptr) {
+            foros::panic("operator new: out of memory");
+        }
+        return ptr;
+    }
+
+    force_inline void deallocate(void *ptr, std::size_t size, std::size_t align) noexcept
+    {
+        kernel_heap::instance().deallocate(ptr, size, align);
+    }
+
+    force_inline void deallocate(void *ptr) noexcept
+    {
+        kernel_heap::instance().deallocate(ptr);
+    }
+
+    force_inline std::size_t array_size(std::size_t size, std::size_t align) noexcept
+    {
+        return kernel_heap::rounded_size(size, align);
+    }
+
+    constexpr const std::size_t default_align = alignof(std::max_align_t);
+}
+
+void *operator new(std::size_t size)
+{
+    return allocate_or_panic(size, default_align);
+}
+
+void *operator new[](std::size_t size)
+{
+    return allocate_or_panic(array_size(size, default_align), default_align);
+}
+
+void *operator new(std::size_t size, std::align_val_t align)
+{
+    return allocate_or_panic(size, static_cast<std::size_t>(align));
+}
+
+void *operator new[](std::size_t size, std::align_val_t align)
+{
+    const auto alignment = static_cast<std::size_t>(align);
+
+    return allocate_or_panic(array_size(size, alignment), alignment);
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept
+{
+    return allocate(size, default_align);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept
+{
+    return allocate(array_size(size, default_align), default_align);
+}
+
+void *operator new(std::size_t size, std::align_val_t align, const std::nothrow_t &) noexcept
+{
+    return allocate(size, static_cast<std::size_t>(align));
+}
+
+void *operator new[](std::size_t size, std::align_val_t align, const std::nothrow_t &) noexcept
+{
+    const auto alignment = static_cast<std::size_t>(align);
+
+    return allocate(array_size(size, alignment), alignment);
+}
+
+void operator delete(void *ptr, std::size_t size) noexcept
+{
+    deallocate(ptr, size, default_align);
+}
+
+void operator delete[](void *ptr, std::size_t size) noexcept
+{
+    deallocate(ptr, array_size(size, default_align), default_align);
+}
+
+void operator delete(void *ptr, std::size_t size, std::align_val_t align) noexcept
+{
+    deallocate(ptr, size, static_cast<std::size_t>(align));
+}
+
+void operator delete[](void *ptr, std::size_t size, std::align_val_t align) noexcept
+{
+    const auto alignment = static_cast<std::size_t>(align);
+
+    deallocate(ptr, array_size(size, alignment), alignment);
+}
+
+void operator delete(void *ptr) noexcept
+{
+    deallocate(ptr);
+}
+
+void operator delete[](void *ptr) noexcept
+{
+    deallocate(ptr);
+}
+
+void operator delete(void *ptr, std::align_val_t) noexcept
+{
+    deallocate(ptr);
+}
+
+void operator delete[](void *ptr, std::align_val_t) noexcept
+{
+    deallocate(ptr);
+}
+
+void operator delete(void *ptr, const std::nothrow_t &) noexcept
+{
+    deallocate(ptr);
+}
+
+void operator delete[](void *ptr, const std::nothrow_t &) noexcept
+{
+    deallocate(ptr);
+}
+
+void operator delete(void *ptr, std::align_val_t, const std::nothrow_t &) noexcept
+{
+    deallocate(ptr);
+}
+
+void operator delete[](void *ptr, std::align_val_t, const std::nothrow_t &) noexcept
+{
+    deallocate(ptr);
+}
@@ -0,0 +1,64 @@
+/*
+** Created by doom on 18/10/26.
+*/
+
+#include "tests_config.hpp"
+#include <arch/x86_64/instructions.hpp>
+#include <memory/kernel_heap.hpp>
+
+using namespace foros;
+using namespace foros::memory;
+
+static constexpr const std::size_t nb_frames = 1024;
+static constexpr const std::size_t nb_rounds = 16;
+
+static physical_frame frames[nb_frames];
+
+static void print_result(const char *name, uint64_t cycles) noexcept
+{
+    vga::scrolling_printer() << "  " << name << ": " << PRINT_CYAN << cycles / (nb_frames * nb_rounds)
+                             << PRINT_WHITE << " cycles per frame\n";
+}
+
+static uint64_t bench_single(physical_frame_allocator &allocator) noexcept
+{
+    uint64_t total = 0;
+
+    for (std::size_t round = 0; round < nb_rounds; ++round) {
+        const auto start = x86_64::instructions::rdtsc();
+
+        for (auto &frame : frames) {
+            frame = allocator.allocate_frame().unwrap_or_panic("bench_single: unable to allocate a frame");
+        }
+        total += x86_64::instructions::rdtsc() - start;
+        for (const auto &frame : frames) {
+            allocator.deallocate_frame(frame);
+        }
+    }
+    return total;
+}
+
+static uint64_t bench_batched(physical_frame_allocator &allocator) noexcept
+{
+    uint64_t total = 0;
+
+    for (std::size_t round = 0; round < nb_rounds; ++round) {
+        const auto start = x86_64::instructions::rdtsc();
+
+        kassert(allocator.allocate_frames(frames) == nb_frames, "bench_batched: unable to allocate frames");
+        total += x86_64::instructions::rdtsc() - start;
+        for (const auto &frame : frames) {
+            allocator.deallocate_frame(frame);
+        }
+    }
+    return total;
+}
+
+void run_frame_allocator_benchmarks()
+{
+    auto &allocator = kernel_heap::instance().frame_allocator();
+
+    vga::scrolling_printer() << "Frame allocation (" << nb_frames << " frames):\n";
+    print_result("allocate_frame", bench_single(allocator));
+    print_result("allocate_frames", bench_batched(allocator));
+}
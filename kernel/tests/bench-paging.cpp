@@ -0,0 +1,110 @@
+/*
+** Created by doom on 18/10/26.
+*/
+
+#include "tests_config.hpp"
+#include <arch/x86_64/instructions.hpp>
+#include <memory/kernel_heap.hpp>
+#include <memory/paging.hpp>
+#include <memory/tlb.hpp>
+
+using namespace foros;
+using namespace foros::memory;
+
+/** Map 64MB, in an area whose P4 entry is not used by the kernel */
+static constexpr const std::size_t nb_pages = 64 * 1024 * 1024 / page_size;
+static constexpr const uintptr_t bench_area_addr = 0x0000408000000000;
+
+/** Number of pages touched after each CR3 reload, small enough to fit in the TLB */
+static constexpr const std::size_t nb_tlb_pages = 64;
+static constexpr const std::size_t nb_tlb_rounds = 64;
+
+/**
+ * The mapping benchmarks map pages to the frames following the last one managed by the allocator, which they never
+ * access. Unmapping them must only give the freed page tables back.
+ */
+struct keep_frames
+{
+    per_cpu_frame_cache &cache;
+    std::size_t first_aliased;
+
+    void deallocate_frame(physical_frame frame) noexcept
+    {
+        if (frame.value() < first_aliased) {
+            cache.deallocate_frame(frame);
+        }
+    }
+};
+
+static void print_result(const char *name, uint64_t cycles) noexcept
+{
+    vga::scrolling_printer() << "  " << name << ": " << PRINT_CYAN << cycles / nb_pages
+                             << PRINT_WHITE << " cycles per page\n";
+}
+
+static void print_access_result(const char *name, uint64_t cycles) noexcept
+{
+    vga::scrolling_printer() << "  " << name << ": " << PRINT_CYAN << cycles << PRINT_WHITE << " cycles per access\n";
+}
+
+static uint64_t bench_map_page(page first_page, std::size_t first_frame, per_cpu_frame_cache &cache) noexcept
+{
+    const auto start = x86_64::instructions::rdtsc();
+
+    for (std::size_t i = 0; i < nb_pages; ++i) {
+        mapper::map_page_to_frame(physical_frame(first_frame + i), page(first_page.value() + i),
+                                  page_table_entry::flags(0), cache);
+    }
+    return x86_64::instructions::rdtsc() - start;
+}
+
+static uint64_t bench_map_range(page first_page, std::size_t first_frame, per_cpu_frame_cache &cache) noexcept
+{
+    const auto start = x86_64::instructions::rdtsc();
+
+    mapper::map_range(first_page, frame_range{first_frame, first_frame + nb_pages}, page_table_entry::flags(0),
+                      cache);
+    return x86_64::instructions::rdtsc() - start;
+}
+
+/** Reload CR3 and measure the cost of touching pages whose translations were cached before the reload */
+static uint64_t bench_tlb_reload(page first_page, page_table_entry::flags entry_flags,
+                                 per_cpu_frame_cache &cache) noexcept
+{
+    uint64_t total = 0;
+
+    mapper::map_range(first_page, nb_tlb_pages, entry_flags, cache);
+    for (std::size_t round = 0; round < nb_tlb_rounds; ++round) {
+        for (std::size_t i = 0; i < nb_tlb_pages; ++i) {
+            (void)*reinterpret_cast<volatile uint8_t *>(page(first_page.value() + i).start_address().value());
+        }
+        x86_64::registers::set_cr3(x86_64::registers::cr3());
+
+        const auto start = x86_64::instructions::rdtsc();
+        for (std::size_t i = 0; i < nb_tlb_pages; ++i) {
+            (void)*reinterpret_cast<volatile uint8_t *>(page(first_page.value() + i).start_address().value());
+        }
+        total += x86_64::instructions::rdtsc() - start;
+    }
+    mapper::unmap_range(first_page, nb_tlb_pages, cache);
+    return total / (nb_tlb_pages * nb_tlb_rounds);
+}
+
+void run_paging_benchmarks()
+{
+    auto &cache = kernel_heap::instance().frame_cache();
+    auto first_page = page::for_address(virtual_address(bench_area_addr));
+    const auto first_frame = kernel_heap::instance().frame_allocator().frames_count();
+    keep_frames keep{cache, first_frame};
+
+    /** Both runs create the page tables they need, which are freed when unmapping */
+    vga::scrolling_printer() << "Mapping 64MB (" << nb_pages << " pages):\n";
+    print_result("map_page_to_frame", bench_map_page(first_page, first_frame, cache));
+    mapper::unmap_range(first_page, nb_pages, keep);
+    print_result("map_range", bench_map_range(first_page, first_frame, cache));
+    mapper::unmap_range(first_page, nb_pages, keep);
+
+    vga::scrolling_printer() << "Access after a CR3 reload (" << nb_tlb_pages << " pages):\n";
+    print_access_result("non-global", bench_tlb_reload(first_page, page_table_entry::flags(0), cache));
+    print_access_result("global", bench_tlb_reload(first_page, page_table_entry::flags::global, cache));
+}
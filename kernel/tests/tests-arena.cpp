@@ -0,0 +1,59 @@
+/*
+** Created by doom on 18/10/26.
+*/
+
+#include <vector>
+#include "tests_config.hpp"
+#include <memory/arena.hpp>
+
+using namespace foros::memory;
+
+ut_test(bump_allocation)
+{
+    arena a;
+    auto *first = static_cast<uint8_t *>(a.allocate(3, 1));
+    auto *second = a.allocate(8, 8);
+
+    ut_assert(first != nullptr && second != nullptr);
+    ut_assert_eq(reinterpret_cast<uintptr_t>(second) % 8, 0);
+    ut_assert(reinterpret_cast<uintptr_t>(second) >= reinterpret_cast<uintptr_t>(first + 3));
+    ut_assert_eq(a.chunks_count(), 1);
+
+    /** Allocations larger than a chunk get a chunk of their own */
+    auto *large = static_cast<volatile uint8_t *>(a.allocate(2 * arena::default_chunk_size));
+    ut_assert(large != nullptr);
+    large[2 * arena::default_chunk_size - 1] = 42;
+    ut_assert_eq(a.chunks_count(), 2);
+
+    /** Reset keeps the first chunk, and starts over from it */
+    a.reset();
+    ut_assert_eq(a.chunks_count(), 1);
+    ut_assert(a.allocate(3, 1) == first);
+}
+
+ut_test(containers)
+{
+    arena a;
+
+    {
+        std::vector<uint64_t, arena_allocator<uint64_t>> v{arena_allocator<uint64_t>(a)};
+
+        for (uint64_t i = 0; i < 1000; ++i) {
+            v.push_back(i);
+        }
+        ut_assert_eq(v.size(), 1000);
+        ut_assert_eq(v[999], 999);
+    }
+    a.reset();
+    ut_assert_eq(a.chunks_count(), 1);
+}
+
+ut_group(arena,
+         ut_get_test(bump_allocation),
+         ut_get_test(containers)
+);
+
+void run_arena_tests()
+{
+    ut_run_group(ut_get_group(arena));
+}
@@ -0,0 +1,65 @@
+/*
+** Created by doom on 18/10/26.
+*/
+
+#include "tests_config.hpp"
+#include <memory/kernel_heap.hpp>
+
+using namespace foros::memory;
+
+ut_test(alignment)
+{
+    auto &allocator = kernel_heap::instance().contiguous_frame_allocator();
+    const auto free_before = allocator.free_frames_count();
+
+    for (std::size_t order = 0; order <= buddy_frame_allocator::max_order; ++order) {
+        auto frame = allocator.allocate_frames(order).unwrap_or_panic("unable to allocate a block");
+
+        ut_assert(allocator.owns(frame));
+        ut_assert_eq(frame.value() % (std::size_t(1) << order), 0);
+        ut_assert_eq(allocator.free_frames_count(), free_before - (std::size_t(1) << order));
+        allocator.free_frames(frame, order);
+        ut_assert_eq(allocator.free_frames_count(), free_before);
+    }
+}
+
+ut_test(merge)
+{
+    auto &allocator = kernel_heap::instance().contiguous_frame_allocator();
+    const auto max_blocks_before = allocator.free_blocks_count(buddy_frame_allocator::max_order);
+
+    /** Split a block into single frames, then free them in an interleaved order */
+    constexpr std::size_t nb_frames = 256;
+    utils::optional<physical_frame> frames[nb_frames];
+
+    for (auto &frame_opt : frames) {
+        frame_opt = allocator.allocate_frames(0);
+        ut_assert(frame_opt.has_value());
+    }
+    for (std::size_t i = 0; i < nb_frames; i += 2) {
+        allocator.free_frames(frames[i].unwrap(), 0);
+    }
+    for (std::size_t i = 1; i < nb_frames; i += 2) {
+        allocator.free_frames(frames[i].unwrap(), 0);
+    }
+    ut_assert_eq(allocator.free_blocks_count(buddy_frame_allocator::max_order), max_blocks_before);
+
+    /** Mixed orders must merge back as well */
+    auto a = allocator.allocate_frames(3).unwrap_or_panic("unable to allocate a block");
+    auto b = allocator.allocate_frames(0).unwrap_or_panic("unable to allocate a block");
+    auto c = allocator.allocate_frames(9).unwrap_or_panic("unable to allocate a block");
+    allocator.free_frames(b, 0);
+    allocator.free_frames(c, 9);
+    allocator.free_frames(a, 3);
+    ut_assert_eq(allocator.free_blocks_count(buddy_frame_allocator::max_order), max_blocks_before);
+}
+
+ut_group(buddy_allocator,
+         ut_get_test(alignment),
+         ut_get_test(merge)
+);
+
+void run_buddy_allocator_tests()
+{
+    ut_run_group(ut_get_group(buddy_allocator));
+}
@@ -0,0 +1,59 @@
+/*
+** Created by doom on 18/10/26.
+*/
+
+#include "tests_config.hpp"
+#include <memory/kernel_heap.hpp>
+
+using namespace foros::memory;
+
+ut_test(ownership)
+{
+    auto &db = kernel_heap::instance().frames();
+    auto &allocator = kernel_heap::instance().frame_allocator();
+
+    ut_assert_eq(db.frames_count(), allocator.frames_count());
+    ut_assert(db.frames_count(frame_owner::heap) > 0);
+    ut_assert_eq(db.frames_count(frame_owner::contiguous),
+                 kernel_heap::instance().contiguous_frame_allocator().frames_count());
+
+    /** Frames outside of the usable regions are reserved */
+    const auto &regions = allocator.regions();
+    if (regions[0].start > 0) {
+        ut_assert(db[physical_frame(0)].owner == frame_owner::reserved);
+    }
+
+    std::size_t total = 0;
+    for (std::size_t i = 0; i < frame_owners_count; ++i) {
+        total += db.frames_count(static_cast<frame_owner>(i));
+    }
+    ut_assert_eq(total, db.frames_count());
+}
+
+ut_test(refcount)
+{
+    auto &db = kernel_heap::instance().frames();
+    auto &allocator = kernel_heap::instance().frame_allocator();
+    auto frame = allocator.allocate_frame().unwrap_or_panic("unable to allocate a frame");
+    const auto heap_frames = db.frames_count(frame_owner::heap);
+
+    db.assign({frame.value(), frame.value() + 1}, frame_owner::heap);
+    ut_assert_eq(db.frames_count(frame_owner::heap), heap_frames + 1);
+    ut_assert_eq(db[frame].refcount, 1);
+    ut_assert_eq(db.get(frame), 2);
+    ut_assert_eq(db.put(frame), 1);
+    ut_assert_eq(db.put(frame), 0);
+    ut_assert(db[frame].owner == frame_owner::none);
+    ut_assert_eq(db.frames_count(frame_owner::heap), heap_frames);
+    allocator.deallocate_frame(frame);
+}
+
+ut_group(frame_database,
+         ut_get_test(ownership),
+         ut_get_test(refcount)
+);
+
+void run_frame_database_tests()
+{
+    ut_run_group(ut_get_group(frame_database));
+}
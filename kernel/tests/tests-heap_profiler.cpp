@@ -0,0 +1,76 @@
+/*
+** Created by doom on 18/10/26.
+*/
+
+#include "tests_config.hpp"
+#include <memory/kernel_heap.hpp>
+
+using namespace foros::memory;
+
+ut_test(sampling)
+{
+    auto &heap = kernel_heap::instance();
+    auto &profiler = heap.profiler();
+
+    profiler.reset();
+    /** Sampling every byte makes every allocation a sample of its own size */
+    profiler.enable(1);
+    void *ptr = heap.allocate(200);
+    const auto *site = profiler.find_site(ptr);
+
+    ut_assert(site != nullptr);
+    ut_assert(site->frames[0] != nullptr);
+    ut_assert_eq(site->live_bytes, 200);
+    ut_assert_eq(profiler.live_samples(), 1);
+    profiler.dump();
+
+    heap.deallocate(ptr, 200);
+    ut_assert(profiler.find_site(ptr) == nullptr);
+    ut_assert_eq(site->live_bytes, 0);
+    ut_assert_eq(site->allocated_bytes, 200);
+    ut_assert_eq(profiler.live_samples(), 0);
+
+    profiler.disable();
+    ptr = heap.allocate(200);
+    ut_assert(profiler.find_site(ptr) == nullptr);
+    heap.deallocate(ptr, 200);
+    profiler.reset();
+}
+
+ut_test(sample_table)
+{
+    auto &heap = kernel_heap::instance();
+    auto &profiler = heap.profiler();
+    void *ptrs[64];
+
+    profiler.reset();
+    profiler.enable(1);
+    for (auto &ptr : ptrs) {
+        ptr = heap.allocate(64);
+    }
+    profiler.disable();
+    ut_assert_eq(profiler.live_samples(), 64);
+    ut_assert_eq(profiler.sites_count(), 1);
+
+    /** Freeing every other sample must not lose the ones probed past them */
+    for (std::size_t i = 0; i < 64; i += 2) {
+        heap.deallocate(ptrs[i], 64);
+    }
+    for (std::size_t i = 1; i < 64; i += 2) {
+        ut_assert(profiler.find_site(ptrs[i]) != nullptr);
+        heap.deallocate(ptrs[i], 64);
+    }
+    ut_assert_eq(profiler.live_samples(), 0);
+    ut_assert_eq(profiler.dropped_samples(), 0);
+    profiler.reset();
+}
+
+ut_group(heap_profiler,
+         ut_get_test(sampling),
+         ut_get_test(sample_table)
+);
+
+void run_heap_profiler_tests()
+{
+    ut_run_group(ut_get_group(heap_profiler));
+}
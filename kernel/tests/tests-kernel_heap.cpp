@@ -0,0 +1,184 @@
+/*
+** Created by doom on 18/10/26.
+*/
+
+#include "tests_config.hpp"
+#include <memory/kernel_heap.hpp>
+#include <utils/kvector.hpp>
+
+using namespace foros::memory;
+
+static bool is_aligned(const void *ptr, std::size_t align) noexcept
+{
+    return reinterpret_cast<uintptr_t>(ptr) % align == 0;
+}
+
+ut_test(small_allocations)
+{
+    auto &heap = kernel_heap::instance();
+    void *ptrs[size_classes_count];
+
+    for (std::size_t i = 0; i < size_classes_count; ++i) {
+        ptrs[i] = heap.allocate(size_classes[i]);
+        ut_assert(ptrs[i] != nullptr);
+        ut_assert(is_aligned(ptrs[i], size_class_alignment(size_classes[i])));
+        ut_assert_eq(heap.allocation_size(ptrs[i]), size_classes[i]);
+    }
+
+    /** Over-aligned requests move up to a class whose objects are aligned enough */
+    void *aligned = heap.allocate(24, 64);
+    ut_assert(is_aligned(aligned, 64));
+    heap.deallocate(aligned, 24, 64);
+
+    for (std::size_t i = 0; i < size_classes_count; ++i) {
+        heap.deallocate(ptrs[i], size_classes[i]);
+    }
+}
+
+ut_test(reuse)
+{
+    auto &heap = kernel_heap::instance();
+    void *first = heap.allocate(100);
+
+    heap.deallocate(first, 100);
+    ut_assert(heap.allocate(100) == first);
+    heap.deallocate(first, 100);
+
+    /** Without reuse, this would need far more than the whole heap area */
+    for (std::size_t round = 0; round < 256; ++round) {
+        void *ptrs[64];
+
+        for (auto &ptr : ptrs) {
+            ptr = heap.allocate(512);
+            ut_assert(ptr != nullptr);
+        }
+        for (auto ptr : ptrs) {
+            heap.deallocate(ptr, 512);
+        }
+    }
+}
+
+ut_test(growth)
+{
+    auto &heap = kernel_heap::instance();
+    const auto chunks_before = heap.mapped_chunks_count();
+    /** Three 1KB objects fit in a slab, so this takes several chunks */
+    constexpr std::size_t count = 4 * kernel_heap::chunk_pages * 3;
+    void *ptrs[count];
+
+    for (auto &ptr : ptrs) {
+        ptr = heap.allocate(1024);
+        ut_assert(ptr != nullptr);
+    }
+    ut_assert(heap.mapped_chunks_count() > chunks_before);
+    for (auto ptr : ptrs) {
+        heap.deallocate(ptr, 1024);
+    }
+    /** The chunks emptied are given back, except the one holding the slab kept for the class */
+    ut_assert(heap.mapped_chunks_count() <= chunks_before + 1);
+    ut_assert(heap.mapped_chunks_count() >= kernel_heap::initial_chunks);
+}
+
+ut_test(chunk_slabs)
+{
+    auto &heap = kernel_heap::instance();
+    const auto chunks_before = heap.mapped_chunks_count();
+    const auto large_before = heap.stats().live_large_allocations;
+    /** Enough pages for a few chunk slabs, none of which is mapped on its own */
+    constexpr std::size_t count = 3 * kernel_heap::chunk_pages;
+    void *ptrs[count];
+
+    for (auto &ptr : ptrs) {
+        ptr = heap.allocate(page_size);
+        ut_assert(ptr != nullptr);
+        ut_assert(is_aligned(ptr, page_size));
+        static_cast<uint8_t *>(ptr)[page_size - 1] = 42;
+    }
+    ut_assert_eq(heap.stats().live_large_allocations, large_before);
+    ut_assert_eq(heap.allocation_size(ptrs[count - 1]), page_size);
+    for (auto ptr : ptrs) {
+        heap.deallocate(ptr, page_size);
+    }
+    ut_assert(heap.mapped_chunks_count() <= chunks_before + 1);
+
+    void *half = heap.allocate(2048);
+    ut_assert_eq(heap.allocation_size(half), 2048);
+    heap.deallocate(half, 2048);
+}
+
+ut_test(large_allocations)
+{
+    auto &heap = kernel_heap::instance();
+    constexpr std::size_t size = 3 * page_size + 5;
+    auto *ptr = static_cast<volatile uint8_t *>(heap.allocate(size));
+
+    ut_assert(ptr != nullptr);
+    ut_assert(is_aligned(const_cast<uint8_t *>(ptr), page_size));
+    ptr[size - 1] = 42;
+    ut_assert_eq(ptr[size - 1], 42);
+    heap.deallocate(const_cast<uint8_t *>(ptr), size);
+    ut_assert_false(mapper::get_frame_for_address(virtual_address(reinterpret_cast<uintptr_t>(ptr))).has_value());
+
+    void *aligned = heap.allocate(100, 4 * page_size);
+    ut_assert(is_aligned(aligned, 4 * page_size));
+    heap.deallocate(aligned, 100, 4 * page_size);
+}
+
+ut_test(statistics)
+{
+    auto &heap = kernel_heap::instance();
+    const auto before = heap.stats();
+    const auto class_128 = size_class_for(128, 16);
+
+    void *small = heap.allocate(100, 8);
+    void *aligned = heap.allocate(24, 64);
+    void *large = heap.allocate(2 * page_size + 1);
+    const auto &stats = heap.stats();
+
+    ut_assert_eq(stats.allocations, before.allocations + 3);
+    ut_assert_eq(stats.live_bytes, before.live_bytes + 100 + 24 + 2 * page_size + 1);
+    ut_assert(stats.peak_live_bytes >= stats.live_bytes);
+    ut_assert_eq(stats.class_live_objects[class_128], before.class_live_objects[class_128] + 1);
+    ut_assert_eq(stats.size_histogram[3], before.size_histogram[3] + 1);
+    /** 24 bytes aligned on 64 take a 64-byte object instead of a 32-byte one */
+    ut_assert_eq(stats.alignment_bytes, before.alignment_bytes + 32);
+    ut_assert_eq(stats.rounding_bytes, before.rounding_bytes + 28 + 40 + page_size - 1);
+    ut_assert_eq(stats.live_large_pages, before.live_large_pages + 3);
+    ut_assert(heap.fragmentation_percent() <= 100);
+    heap.dump_statistics();
+
+    heap.deallocate(large, 2 * page_size + 1);
+    heap.deallocate(aligned, 24, 64);
+    heap.deallocate(small, 100, 8);
+    ut_assert_eq(stats.deallocations, before.deallocations + 3);
+    ut_assert_eq(stats.live_bytes, before.live_bytes);
+    ut_assert_eq(stats.rounding_bytes, before.rounding_bytes);
+    ut_assert_eq(stats.alignment_bytes, before.alignment_bytes);
+    ut_assert_eq(stats.live_large_pages, before.live_large_pages);
+}
+
+ut_test(kvector_growth)
+{
+    kvector<int> v;
+
+    for (int i = 0; i < 2048; ++i) {
+        v.push_back(i);
+    }
+    ut_assert_eq(v.size(), 2048);
+    ut_assert_eq(v[1234], 1234);
+}
+
+ut_group(kernel_heap,
+         ut_get_test(small_allocations),
+         ut_get_test(reuse),
+         ut_get_test(growth),
+         ut_get_test(chunk_slabs),
+         ut_get_test(large_allocations),
+         ut_get_test(statistics),
+         ut_get_test(kvector_growth)
+);
+
+void run_kernel_heap_tests()
+{
+    ut_run_group(ut_get_group(kernel_heap));
+}
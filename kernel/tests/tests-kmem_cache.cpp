@@ -0,0 +1,117 @@
+/*
+** Created by doom on 18/10/26.
+*/
+
+#include "tests_config.hpp"
+#include <memory/kmem_cache.hpp>
+
+using namespace foros::memory;
+
+namespace
+{
+    struct request
+    {
+        static inline std::size_t constructions = 0;
+        static inline std::size_t destructions = 0;
+
+        request() noexcept : request(0)
+        {
+        }
+
+        explicit request(uint64_t id) noexcept : id(id)
+        {
+            ++constructions;
+        }
+
+        ~request() noexcept
+        {
+            ++destructions;
+        }
+
+        uint64_t id;
+        /** Sized so that slabs have room for more than one color */
+        uint64_t payload[14]{};
+    };
+}
+
+ut_test(allocation)
+{
+    kmem_cache<request> cache;
+    auto *first = cache.allocate(1);
+    auto *second = cache.allocate(2);
+
+    ut_assert(first != nullptr && second != nullptr && first != second);
+    ut_assert_eq(first->id, 1);
+    ut_assert_eq(second->id, 2);
+    ut_assert_eq(reinterpret_cast<uintptr_t>(first) % alignof(request), 0);
+    ut_assert_eq(cache.objects_in_use(), 2);
+
+    const auto destructions = request::destructions;
+    cache.deallocate(second);
+    ut_assert_eq(request::destructions, destructions + 1);
+
+    /** The last freed object is the first reused */
+    auto *third = cache.allocate(3);
+    ut_assert(third == second);
+    cache.deallocate(third);
+    cache.deallocate(first);
+    ut_assert_eq(cache.objects_in_use(), 0);
+    ut_assert_eq(cache.slabs_count(), 1);
+}
+
+ut_test(constructed_state)
+{
+    using cache_type = kmem_cache<request, true>;
+    const auto constructions = request::constructions;
+    cache_type cache;
+    auto *obj = cache.allocate();
+
+    /** The whole slab is constructed at once */
+    ut_assert_eq(request::constructions, constructions + cache_type::objects_per_slab);
+    obj->id = 42;
+    cache.deallocate(obj);
+
+    auto *again = cache.allocate();
+    ut_assert(again == obj);
+    ut_assert_eq(again->id, 42);
+    ut_assert_eq(request::constructions, constructions + cache_type::objects_per_slab);
+    cache.deallocate(again);
+
+    const auto destructions = request::destructions;
+    cache.shrink();
+    ut_assert_eq(request::destructions, destructions + cache_type::objects_per_slab);
+    ut_assert_eq(cache.slabs_count(), 0);
+}
+
+ut_test(coloring)
+{
+    using cache_type = kmem_cache<request>;
+    cache_type cache;
+    request *objects[cache_type::objects_per_slab + 1];
+
+    for (auto &obj : objects) {
+        obj = cache.allocate(0);
+    }
+    ut_assert_eq(cache.slabs_count(), 2);
+
+    /** The first objects of the two slabs do not sit at the same offset in their pages */
+    const auto first_offset = reinterpret_cast<uintptr_t>(objects[0]) % page_size;
+    const auto second_offset = reinterpret_cast<uintptr_t>(objects[cache_type::objects_per_slab]) % page_size;
+    ut_assert(first_offset != second_offset);
+
+    for (auto obj : objects) {
+        cache.deallocate(obj);
+    }
+    ut_assert_eq(cache.objects_in_use(), 0);
+}
+
+ut_group(kmem_cache,
+         ut_get_test(allocation),
+         ut_get_test(constructed_state),
+         ut_get_test(coloring)
+);
+
+void run_kmem_cache_tests()
+{
+    ut_run_group(ut_get_group(kmem_cache));
+}
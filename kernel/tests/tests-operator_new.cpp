@@ -0,0 +1,107 @@
+/*
+** Created by doom on 18/10/26.
+*/
+
+#include <new>
+#include "tests_config.hpp"
+#include <memory/kernel_heap.hpp>
+
+using namespace foros::memory;
+
+namespace
+{
+    struct alignas(256) cache_block
+    {
+        uint8_t data[100];
+    };
+
+    struct alignas(2 * page_size) page_block
+    {
+        uint8_t data[page_size];
+    };
+
+    bool is_aligned(const void *ptr, std::size_t align) noexcept
+    {
+        return reinterpret_cast<uintptr_t>(ptr) % align == 0;
+    }
+}
+
+ut_test(allocation_size)
+{
+    auto &heap = kernel_heap::instance();
+    constexpr std::size_t large_size = 3 * page_size + 5;
+
+    ut_assert_eq(kernel_heap::rounded_size(100), 128);
+    ut_assert_eq(kernel_heap::rounded_size(24, 64), 64);
+    ut_assert_eq(kernel_heap::rounded_size(large_size), 4 * page_size);
+
+    void *small = heap.allocate(100);
+    void *large = heap.allocate(large_size);
+    ut_assert_eq(heap.allocation_size(small), 128);
+    ut_assert_eq(heap.allocation_size(large), 4 * page_size);
+    heap.deallocate(large, large_size);
+    heap.deallocate(small, 100);
+}
+
+ut_test(scalar_and_array)
+{
+    const auto &stats = kernel_heap::instance().stats();
+    const auto live_bytes = stats.live_bytes;
+    const auto allocations = stats.allocations;
+    const auto rounding_bytes = stats.rounding_bytes;
+
+    /** The requested size reaches the heap, so the rounding to the size class shows in the statistics */
+    auto *value = new uint64_t(42);
+    ut_assert_eq(*value, 42);
+    ut_assert_eq(stats.live_bytes, live_bytes + sizeof(uint64_t));
+    ut_assert_eq(stats.rounding_bytes, rounding_bytes + kernel_heap::rounded_size(sizeof(uint64_t)) - sizeof(uint64_t));
+    delete value;
+    ut_assert_eq(stats.rounding_bytes, rounding_bytes);
+
+    /** Arrays of trivial types are freed without their size, so arrays are counted at their rounded size */
+    auto *small_array = new uint32_t[20]();
+    auto *large_array = new uint32_t[3000]();
+    small_array[19] = 19;
+    large_array[2999] = 2999;
+    ut_assert_eq(small_array[19] + large_array[2999], 3018);
+    delete[] large_array;
+    ut_assert_eq(stats.live_bytes, live_bytes + kernel_heap::rounded_size(20 * sizeof(uint32_t)));
+    delete[] small_array;
+
+    ut_assert_eq(stats.live_bytes, live_bytes);
+    ut_assert_eq(stats.rounding_bytes, rounding_bytes);
+    ut_assert_eq(stats.allocations, allocations + 3);
+}
+
+ut_test(over_aligned)
+{
+    const auto &stats = kernel_heap::instance().stats();
+    const auto live_bytes = stats.live_bytes;
+    const auto alignment_bytes = stats.alignment_bytes;
+
+    auto *block = new cache_block;
+    auto *page = new page_block;
+    ut_assert(is_aligned(block, alignof(cache_block)));
+    ut_assert(is_aligned(page, alignof(page_block)));
+    delete page;
+    delete block;
+    ut_assert_eq(stats.live_bytes, live_bytes);
+    ut_assert_eq(stats.alignment_bytes, alignment_bytes);
+
+    auto *nothrow_block = new (std::nothrow) cache_block[3];
+    ut_assert(nothrow_block != nullptr && is_aligned(nothrow_block, alignof(cache_block)));
+    delete[] nothrow_block;
+    ut_assert_eq(stats.live_bytes, live_bytes);
+    ut_assert_eq(stats.alignment_bytes, alignment_bytes);
+}
+
+ut_group(operator_new,
+         ut_get_test(allocation_size),
+         ut_get_test(scalar_and_array),
+         ut_get_test(over_aligned)
+);
+
+void run_operator_new_tests()
+{
+    ut_run_group(ut_get_group(operator_new));
+}
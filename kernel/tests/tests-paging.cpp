@@ -0,0 +1,258 @@
+/*
+** Created by doom on 18/10/26.
+*/
+
+#include "tests_config.hpp"
+#include <memory/address_space.hpp>
+#include <memory/demand_paging.hpp>
+#include <memory/kernel_heap.hpp>
+#include <memory/paging.hpp>
+#include <memory/pat.hpp>
+
+using namespace foros::memory;
+
+/** An address whose P4 entry is not used by the kernel */
+static constexpr const uintptr_t test_area_addr = 0x0000400000000000;
+
+ut_test(identity_map_translation)
+{
+    /** The boot code maps the first GiB with 2MB pages, so this goes through a huge P2 entry */
+    const uintptr_t addr = 0x1234567;
+    auto frame = mapper::get_frame_for_address(virtual_address(addr));
+
+    ut_assert(frame.has_value());
+    ut_assert_eq(frame.unwrap().value(), addr / page_size);
+}
+
+ut_test(direct_map)
+{
+    auto &heap = kernel_heap::instance();
+    auto frame = heap.frame_cache().allocate_frame().unwrap_or_panic("unable to allocate a frame");
+    const auto addr = phys_to_virt(frame.start_address());
+
+    ut_assert(addr.value() >= direct_map_base);
+    ut_assert_eq(virt_to_phys(addr).value(), frame.start_address().value());
+
+    /** The direct map is built with huge pages, which the mapper translates as well */
+    auto translated = mapper::get_frame_for_address(addr + 123);
+    ut_assert(translated.has_value());
+    ut_assert_eq(translated.unwrap().value(), frame.value());
+
+    /** Both mappings of the frame must see the same memory */
+    *reinterpret_cast<volatile uint64_t *>(addr.value()) = 0xcafe;
+    ut_assert_eq(*reinterpret_cast<volatile uint64_t *>(frame.start_address().value()), 0xcafe);
+    heap.frame_cache().deallocate_frame(frame);
+
+    /** Ranges past the mapped memory or wrapping around the address space are not direct-mapped */
+    ut_assert_false(is_direct_mapped(physical_address(direct_map_max_size)));
+    ut_assert_false(is_direct_mapped(physical_address(~uintptr_t(0) - page_size + 1), 2 * page_size));
+}
+
+ut_test(huge_pages)
+{
+    auto &heap = kernel_heap::instance();
+    auto &buddy = heap.contiguous_frame_allocator();
+    auto block = buddy.allocate_frames(buddy_frame_allocator::order_2m)
+        .unwrap_or_panic("unable to allocate a 2MB block");
+    auto first_page = page::for_address(virtual_address(test_area_addr));
+
+    mapper::map_huge_page_to_frame(block, first_page, huge_page_size::size_2m,
+                                   page_table_entry::flags::writable, heap.frame_cache());
+
+    auto frame = mapper::get_frame_for_page(page(first_page.value() + 42));
+    ut_assert(frame.has_value());
+    ut_assert_eq(frame.unwrap().value(), block.value() + 42);
+
+    /** Writing through the huge page must reach the block through the direct map as well */
+    auto *virt = reinterpret_cast<volatile uint64_t *>(test_area_addr + 42 * page_size);
+    auto *phys = reinterpret_cast<volatile uint64_t *>(phys_to_virt((block + 42).start_address()).value());
+    *virt = 0xdeadbeef;
+    ut_assert_eq(*phys, 0xdeadbeef);
+
+    auto unmapped = mapper::unmap_huge_page(first_page, huge_page_size::size_2m, heap.frame_cache());
+    ut_assert_eq(unmapped.value(), block.value());
+    ut_assert_false(mapper::get_frame_for_page(first_page).has_value());
+    buddy.free_frames(block, buddy_frame_allocator::order_2m);
+}
+
+ut_test(ranges)
+{
+    auto &cache = kernel_heap::instance().frame_cache();
+    const auto free_before = cache.global_allocator().free_frames_count() + cache.cached_frames_count();
+
+    /** Start in the middle of a P1 table so that the range spans three of them */
+    auto first_page = page(page::for_address(virtual_address(test_area_addr)).value() + 300);
+    constexpr std::size_t nb_pages = 2 * page_entries_count;
+
+    mapper::map_range(first_page, nb_pages, page_table_entry::flags::writable, cache);
+    for (std::size_t i = 0; i < nb_pages; ++i) {
+        ut_assert(mapper::get_frame_for_page(page(first_page.value() + i)).has_value());
+    }
+    mapper::unmap_range(first_page, nb_pages, cache);
+    for (std::size_t i = 0; i < nb_pages; ++i) {
+        ut_assert_false(mapper::get_frame_for_page(page(first_page.value() + i)).has_value());
+    }
+
+    /** The page tables created for the range must have been freed as well */
+    const auto free_after = cache.global_allocator().free_frames_count() + cache.cached_frames_count();
+    ut_assert_eq(free_after, free_before);
+}
+
+ut_test(tlb_batch)
+{
+    tlb_flush_batch batch(4);
+
+    for (std::size_t i = 0; i < 4; ++i) {
+        batch.add(virtual_address(test_area_addr + i * page_size));
+    }
+    ut_assert_eq(batch.size(), 4);
+    ut_assert_false(batch.needs_full_flush());
+
+    batch.add(virtual_address(test_area_addr + 4 * page_size));
+    ut_assert(batch.needs_full_flush());
+
+    batch.flush();
+    ut_assert_eq(batch.size(), 0);
+    ut_assert_false(batch.needs_full_flush());
+
+    /** Frames are only given back once their stale translations are gone */
+    struct counting_allocator
+    {
+        void deallocate_frame(physical_frame) noexcept
+        {
+            ++freed;
+        }
+
+        std::size_t freed{0};
+    } counter;
+
+    batch.add(virtual_address(test_area_addr));
+    batch.defer_free(physical_frame(42), counter);
+    ut_assert_eq(counter.freed, 0);
+    batch.flush();
+    ut_assert_eq(counter.freed, 1);
+}
+
+ut_test(address_spaces)
+{
+    auto &pool = kernel_heap::instance().zeroed_frames();
+    auto space = address_space::create(pool).unwrap_or_panic("unable to create an address space");
+    auto user_page = page::for_address(virtual_address(0x0000008000000000));
+
+    ut_assert(address_space::kernel().is_active());
+    ut_assert(space.pcid() != 0);
+
+    space.activate();
+    ut_assert(space.is_active());
+    mapper::map_page(user_page, page_table_entry::flags::writable, pool);
+    *reinterpret_cast<volatile uint64_t *>(user_page.start_address().value()) = 42;
+    /** Kernel memory stays reachable */
+    ut_assert(mapper::get_frame_for_address(virtual_address(0x1000)).has_value());
+
+    address_space::kernel().activate();
+    ut_assert_false(mapper::get_frame_for_page(user_page).has_value());
+
+    space.activate();
+    ut_assert_eq(*reinterpret_cast<volatile uint64_t *>(user_page.start_address().value()), 42);
+    mapper::unmap(user_page, pool);
+
+    address_space::kernel().activate();
+    space.destroy(pool);
+}
+
+ut_test(translation_caching)
+{
+    auto &cache = kernel_heap::instance().frame_cache();
+    const auto &stats = translation_cache::instance().stats();
+    auto p = page::for_address(virtual_address(test_area_addr));
+
+    mapper::map_page(p, page_table_entry::flags::writable, cache);
+    auto frame = mapper::get_frame_for_page(p).unwrap_or_panic("page is not mapped");
+
+    const auto hits_before = stats.hits;
+    ut_assert_eq(mapper::get_frame_for_page(p).unwrap().value(), frame.value());
+    ut_assert_eq(stats.hits, hits_before + 1);
+
+    /** Unmapping must not leave a stale translation behind */
+    mapper::unmap(p, cache);
+    ut_assert_false(mapper::get_frame_for_page(p).has_value());
+}
+
+ut_test(demand_paging)
+{
+    auto &regions = demand_paged_regions::instance();
+    auto &pool = kernel_heap::instance().zeroed_frames();
+    const auto faults_before = regions.faults_handled();
+    constexpr std::size_t nb_pages = 16;
+
+    regions.add(virtual_address(test_area_addr), nb_pages * page_size, page_table_entry::flags::writable);
+    ut_assert_false(mapper::get_frame_for_address(virtual_address(test_area_addr)).has_value());
+
+    /** Only the pages that are touched get backed, with zeroed frames */
+    auto *words = reinterpret_cast<volatile uint64_t *>(test_area_addr + 3 * page_size);
+    ut_assert_eq(words[0], 0);
+    words[1] = 42;
+    ut_assert_eq(words[1], 42);
+    ut_assert_eq(regions.faults_handled(), faults_before + 1);
+    ut_assert(mapper::get_frame_for_address(virtual_address(test_area_addr + 3 * page_size)).has_value());
+    ut_assert_false(mapper::get_frame_for_address(virtual_address(test_area_addr + 4 * page_size)).has_value());
+
+    regions.remove(virtual_address(test_area_addr), pool);
+    ut_assert_false(mapper::get_frame_for_address(virtual_address(test_area_addr + 3 * page_size)).has_value());
+}
+
+ut_test(memory_types)
+{
+    if (foros::cpu_supports_pat()) {
+        ut_assert_eq(foros::x86_64::instructions::rdmsr(pat_msr), pat_value);
+    }
+
+    /** The memory type is encoded with the same flags whatever the level of the entry */
+    for (auto type : {memory_type::write_back, memory_type::write_combining,
+                      memory_type::uncached_minus, memory_type::uncached}) {
+        page_table_entry entry(0);
+        const auto entry_flags = page_table_entry::flags::present | page_table_entry::memory_type_flags(type);
+
+        entry.set_frame(physical_frame(42), entry_flags);
+        ut_assert(entry.get_memory_type() == type);
+        ut_assert_eq(entry.get_frame().unwrap().value(), 42);
+    }
+
+    /**
+     * Mapping RAM with another memory type than its direct mapping is undefined, so the window points past the
+     * memory mapped by the kernel. It is never accessed, only mapped and unmapped.
+     */
+    auto &heap = kernel_heap::instance();
+    const auto end_frame = heap.frame_allocator().regions().end_frame();
+    const auto unmapped_addr = std::max((end_frame * page_size + page_size_2m - 1) / page_size_2m * page_size_2m,
+                                        identity_mapped_size);
+    const auto frame = physical_frame::for_address(physical_address(unmapped_addr));
+    ut_assert_false(is_direct_mapped(frame));
+
+    const auto allocated_pages = heap.virtual_ranges().allocated_pages_count();
+    auto window = heap.virtual_ranges().map_physical(frame.start_address(), page_size, memory_type::write_combining,
+                                                     heap.zeroed_frames())
+        .unwrap_or_panic("unable to map a write-combining window");
+    ut_assert_eq(mapper::get_frame_for_address(window).unwrap().value(), frame.value());
+
+    heap.virtual_ranges().unmap_physical(window, page_size, heap.zeroed_frames());
+    ut_assert_false(mapper::get_frame_for_address(window).has_value());
+    ut_assert_eq(heap.virtual_ranges().allocated_pages_count(), allocated_pages);
+}
+
+ut_group(paging,
+         ut_get_test(identity_map_translation),
+         ut_get_test(direct_map),
+         ut_get_test(huge_pages),
+         ut_get_test(ranges),
+         ut_get_test(tlb_batch),
+         ut_get_test(address_spaces),
+         ut_get_test(translation_caching),
+         ut_get_test(demand_paging),
+         ut_get_test(memory_types)
+);
+
+void run_paging_tests()
+{
+    ut_run_group(ut_get_group(paging));
+}
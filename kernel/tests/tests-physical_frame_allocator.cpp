@@ -3,13 +3,14 @@
 */
 
 #include "tests_config.hpp"
-#include <memory/physical_frame.hpp>
+#include <memory/kernel_heap.hpp>
 
 ut_test(usage)
 {
     using namespace foros::memory;
 
-    auto allocator = physical_frame_allocator::create(tests_context::instance().boot_information());
+    /** The allocator owns the frames of the whole machine, so use the kernel one instead of creating another */
+    auto &allocator = kernel_heap::instance().frame_allocator();
 
     auto elf_sect_it = tests_context::instance().boot_information().tag<mb2::elf_sections_tag>().sections_begin();
     auto elf_sect_end = tests_context::instance().boot_information().tag<mb2::elf_sections_tag>().sections_end();
@@ -29,16 +30,168 @@ ut_test(usage)
     auto multiboot_start = physical_address(tests_context::instance().boot_information().start_address());
     auto multiboot_end = physical_address(tests_context::instance().boot_information().end_address());
 
-    while (auto opt = allocator.allocate_frame()) {
-        ut_assert_false(physical_frame::for_address(kern_start) < opt.unwrap()
-                        && opt.unwrap() < physical_frame::for_address(kern_end));
-        ut_assert_false(physical_frame::for_address(multiboot_start) < opt.unwrap()
-                        && opt.unwrap() < physical_frame::for_address(multiboot_end));
+    for (auto f = physical_frame::for_address(kern_start); f <= physical_frame::for_address(kern_end); f = f + 1) {
+        ut_assert_false(allocator.is_frame_free(f));
     }
+    for (auto f = physical_frame::for_address(multiboot_start);
+         f <= physical_frame::for_address(multiboot_end); f = f + 1) {
+        ut_assert_false(allocator.is_frame_free(f));
+    }
+
+    constexpr std::size_t nb_frames = 256;
+    utils::optional<physical_frame> frames[nb_frames];
+    const auto free_before = allocator.free_frames_count();
+
+    for (auto &frame_opt : frames) {
+        frame_opt = allocator.allocate_frame();
+        ut_assert(frame_opt.has_value());
+
+        auto frame = frame_opt.unwrap();
+        ut_assert_false(allocator.is_frame_free(frame));
+        ut_assert_false(physical_frame::for_address(kern_start) <= frame
+                        && frame <= physical_frame::for_address(kern_end));
+        ut_assert_false(physical_frame::for_address(multiboot_start) <= frame
+                        && frame <= physical_frame::for_address(multiboot_end));
+    }
+    ut_assert_eq(allocator.free_frames_count(), free_before - nb_frames);
+
+    for (const auto &frame_opt : frames) {
+        allocator.deallocate_frame(frame_opt.unwrap());
+    }
+    ut_assert_eq(allocator.free_frames_count(), free_before);
+}
+
+ut_test(reuse)
+{
+    using namespace foros::memory;
+
+    auto &allocator = kernel_heap::instance().frame_allocator();
+
+    auto first = allocator.allocate_frame().unwrap_or_panic("unable to allocate a frame");
+    auto second = allocator.allocate_frame().unwrap_or_panic("unable to allocate a frame");
+    ut_assert(first.value() != second.value());
+
+    /** Freed frames must be handed out again */
+    allocator.deallocate_frame(first);
+    ut_assert(allocator.is_frame_free(first));
+    auto third = allocator.allocate_frame().unwrap_or_panic("unable to allocate a frame");
+    ut_assert_eq(third.value(), first.value());
+
+    allocator.deallocate_frame(second);
+    allocator.deallocate_frame(third);
+}
+
+ut_test(batch)
+{
+    using namespace foros::memory;
+
+    auto &allocator = kernel_heap::instance().frame_allocator();
+    const auto free_before = allocator.free_frames_count();
+
+    auto run = allocator.allocate_run(64);
+    ut_assert_false(run.empty());
+    ut_assert(run.size() <= 64);
+    for (auto frame = run.start; frame < run.end; ++frame) {
+        ut_assert_false(allocator.is_frame_free(physical_frame(frame)));
+    }
+    allocator.deallocate_run(run);
+    ut_assert_eq(allocator.free_frames_count(), free_before);
+
+    physical_frame frames[128];
+    ut_assert_eq(allocator.allocate_frames(frames), 128);
+    for (std::size_t i = 0; i < 128; ++i) {
+        ut_assert_false(allocator.is_frame_free(frames[i]));
+        if (i > 0) {
+            ut_assert(frames[i - 1] < frames[i]);
+        }
+    }
+    for (const auto &frame : frames) {
+        allocator.deallocate_frame(frame);
+    }
+    ut_assert_eq(allocator.free_frames_count(), free_before);
+}
+
+ut_test(regions)
+{
+    using namespace foros::memory;
+
+    const auto &regions = kernel_heap::instance().frame_allocator().regions();
+    auto multiboot_start = physical_address(tests_context::instance().boot_information().start_address());
+    auto multiboot_end = physical_address(tests_context::instance().boot_information().end_address());
+    const frame_range multiboot{physical_frame::for_address(multiboot_start).value(),
+                                physical_frame::for_address(multiboot_end).value() + 1};
+
+    ut_assert(regions.size() > 0);
+    for (std::size_t i = 0; i < regions.size(); ++i) {
+        ut_assert_false(regions[i].empty());
+        ut_assert_false(regions[i].overlaps(multiboot));
+        ut_assert_eq(regions.index_of(regions[i].start), i);
+        ut_assert_eq(regions.index_of(regions[i].end - 1), i);
+        if (i > 0) {
+            /** Regions are sorted, and touching regions are merged */
+            ut_assert(regions[i - 1].end < regions[i].start);
+        }
+    }
+}
+
+ut_test(per_cpu_cache)
+{
+    using namespace foros::memory;
+
+    auto &cache = kernel_heap::instance().frame_cache();
+    const auto stats_before = cache.stats();
+
+    /** Allocating and freeing the same frame repeatedly must be served by the magazine */
+    for (std::size_t i = 0; i < per_cpu_frame_cache::magazine_capacity; ++i) {
+        auto frame = cache.allocate_frame().unwrap_or_panic("unable to allocate a frame");
+        ut_assert_false(cache.global_allocator().is_frame_free(frame));
+        cache.deallocate_frame(frame);
+    }
+
+    const auto stats_after = cache.stats();
+    ut_assert(stats_after.allocation_misses - stats_before.allocation_misses <= 1);
+    ut_assert_eq(stats_after.free_misses, stats_before.free_misses);
+
+    const auto global_free = cache.global_allocator().free_frames_count();
+    const auto cached = cache.cached_frames_count();
+    cache.flush();
+    ut_assert_eq(cache.cached_frames_count(), 0);
+    ut_assert_eq(cache.global_allocator().free_frames_count(), global_free + cached);
+}
+
+ut_test(zeroed_pool)
+{
+    using namespace foros::memory;
+
+    auto &pool = kernel_heap::instance().zeroed_frames();
+
+    for (std::size_t i = 0; i < zeroed_frame_pool::capacity / zeroed_frame_pool::refill_batch + 1; ++i) {
+        if (pool.refill()) {
+            break;
+        }
+    }
+    ut_assert_eq(pool.size(), zeroed_frame_pool::capacity);
+
+    const auto hits_before = pool.stats().hits;
+    auto frame = pool.allocate_zeroed_frame().unwrap_or_panic("unable to allocate a zeroed frame");
+    ut_assert_eq(pool.stats().hits, hits_before + 1);
+
+    const auto *words = reinterpret_cast<const uint64_t *>(phys_to_virt(frame.start_address()).value());
+    bool zeroed = true;
+    for (std::size_t i = 0; i < page_size / sizeof(uint64_t); ++i) {
+        zeroed = zeroed && words[i] == 0;
+    }
+    ut_assert(zeroed);
+    pool.deallocate_frame(frame);
 }
 
 ut_group(physical_frame_allocator,
-         ut_get_test(usage)
+         ut_get_test(usage),
+         ut_get_test(reuse),
+         ut_get_test(batch),
+         ut_get_test(regions),
+         ut_get_test(per_cpu_cache),
+         ut_get_test(zeroed_pool)
 );
 
 void run_physical_frame_allocator_tests()
@@ -0,0 +1,130 @@
+/*
+** Created by doom on 18/10/26.
+*/
+
+#include "tests_config.hpp"
+#include <memory/kernel_heap.hpp>
+#include <memory/virtual_range_allocator.hpp>
+
+using namespace foros::memory;
+
+/** An area whose P4 entry is not used by the kernel */
+static constexpr const uintptr_t test_area_start = 0x0000410000000000;
+static constexpr const uintptr_t test_area_end = test_area_start + 64 * page_size;
+
+ut_test(reservation)
+{
+    virtual_range_allocator ranges{virtual_address(test_area_start), virtual_address(test_area_end)};
+
+    auto first = ranges.allocate(4 * page_size).unwrap_or_panic("unable to allocate a range");
+    auto second = ranges.allocate(1).unwrap_or_panic("unable to allocate a range");
+
+    /** Every range is surrounded by guard pages */
+    ut_assert_eq(first.value(), test_area_start + page_size);
+    ut_assert_eq(second.value(), first.value() + 5 * page_size);
+    ut_assert_eq(ranges.allocated_pages_count(), 5);
+    ut_assert_eq(ranges.largest_free_range(), 64 - 1 - 5 - 2);
+
+    /** Too large */
+    ut_assert_false(ranges.allocate(64 * page_size).has_value());
+
+    auto aligned = ranges.allocate(page_size, 16 * page_size).unwrap_or_panic("unable to allocate a range");
+    ut_assert_eq(aligned.value() % (16 * page_size), 0);
+    ut_assert_eq(ranges.free_ranges_count(), 2);
+
+    ranges.free(aligned, page_size);
+    ranges.free(second, 1);
+    ranges.free(first, 4 * page_size);
+    ut_assert_eq(ranges.allocated_pages_count(), 0);
+}
+
+ut_test(coalescing)
+{
+    virtual_range_allocator ranges{virtual_address(test_area_start), virtual_address(test_area_end)};
+    virtual_address starts[3]{virtual_address(0), virtual_address(0), virtual_address(0)};
+
+    for (auto &start : starts) {
+        start = ranges.allocate(2 * page_size).unwrap_or_panic("unable to allocate a range");
+    }
+    ut_assert_eq(ranges.free_ranges_count(), 1);
+
+    ranges.free(starts[1], 2 * page_size);
+    ut_assert_eq(ranges.free_ranges_count(), 2);
+
+    /** The freed range is reused first */
+    auto reused = ranges.allocate(2 * page_size).unwrap_or_panic("unable to allocate a range");
+    ut_assert_eq(reused.value(), starts[1].value());
+    ranges.free(reused, 2 * page_size);
+
+    ranges.free(starts[0], 2 * page_size);
+    ut_assert_eq(ranges.free_ranges_count(), 2);
+    ranges.free(starts[2], 2 * page_size);
+    ut_assert_eq(ranges.free_ranges_count(), 1);
+    ut_assert_eq(ranges.largest_free_range(), 64 - 1);
+}
+
+ut_test(fragmentation)
+{
+    /** Every other range freed leaves more free ranges than the inline table holds */
+    constexpr std::size_t count = 2 * virtual_range_allocator::max_free_ranges + 8;
+    virtual_range_allocator ranges{virtual_address(test_area_start),
+                                   virtual_address(test_area_start + (2 * count + 16) * page_size)};
+    uintptr_t starts[count];
+
+    ranges.set_table_allocator([](std::size_t size) noexcept {
+        return kernel_heap::instance().allocate(size);
+    }, [](void *ptr, std::size_t size) noexcept {
+        kernel_heap::instance().deallocate(ptr, size);
+    });
+    for (auto &start : starts) {
+        start = ranges.allocate(page_size).unwrap_or_panic("unable to allocate a range").value();
+    }
+    for (std::size_t i = 0; i < count; i += 2) {
+        ranges.free(virtual_address(starts[i]), page_size);
+    }
+    ut_assert(ranges.free_ranges_count() > virtual_range_allocator::max_free_ranges);
+
+    /** Splitting a free range with an aligned allocation needs a slot as well */
+    auto aligned = ranges.allocate(page_size, 4 * page_size);
+    ut_assert(aligned.has_value());
+    ranges.free(aligned.unwrap(), page_size);
+
+    for (std::size_t i = 1; i < count; i += 2) {
+        ranges.free(virtual_address(starts[i]), page_size);
+    }
+    ut_assert_eq(ranges.free_ranges_count(), 1);
+    ut_assert_eq(ranges.allocated_pages_count(), 0);
+}
+
+ut_test(mapped_ranges)
+{
+    auto &heap = kernel_heap::instance();
+    auto &ranges = heap.virtual_ranges();
+    const auto allocated_before = ranges.allocated_pages_count();
+    auto start = ranges.allocate_mapped(3 * page_size, page_table_entry::flags::writable, heap.zeroed_frames())
+        .unwrap_or_panic("unable to allocate a mapped range");
+
+    ut_assert(start.value() >= kernel_ranges_start && start.value() < kernel_ranges_end);
+    ut_assert_eq(ranges.allocated_pages_count(), allocated_before + 3);
+    for (std::size_t i = 0; i < 3; ++i) {
+        ut_assert(mapper::get_frame_for_address(start + i * page_size).has_value());
+    }
+    ut_assert_false(mapper::get_frame_for_address(start + 3 * page_size).has_value());
+
+    *reinterpret_cast<volatile uint64_t *>(start.value() + 2 * page_size) = 42;
+    ranges.free_mapped(start, 3 * page_size, heap.zeroed_frames());
+    ut_assert_false(mapper::get_frame_for_address(start).has_value());
+    ut_assert_eq(ranges.allocated_pages_count(), allocated_before);
+}
+
+ut_group(virtual_range_allocator,
+         ut_get_test(reservation),
+         ut_get_test(coalescing),
+         ut_get_test(fragmentation),
+         ut_get_test(mapped_ranges)
+);
+
+void run_virtual_range_allocator_tests()
+{
+    ut_run_group(ut_get_group(virtual_range_allocator));
+}
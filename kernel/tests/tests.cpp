@@ -9,6 +9,17 @@
 void run_bit_field_tests();
 void run_optional_tests();
 void run_physical_frame_allocator_tests();
+void run_buddy_allocator_tests();
+void run_frame_database_tests();
+void run_paging_tests();
+void run_virtual_range_allocator_tests();
+void run_kernel_heap_tests();
+void run_heap_profiler_tests();
+void run_kmem_cache_tests();
+void run_arena_tests();
+void run_operator_new_tests();
+void run_frame_allocator_benchmarks();
+void run_paging_benchmarks();
 
 void run_tests(const multiboot2::boot_information &boot_info)
 {
@@ -19,6 +30,18 @@ void run_tests(const multiboot2::boot_information &boot_info)
     run_bit_field_tests();
     run_optional_tests();
     run_physical_frame_allocator_tests();
+    run_buddy_allocator_tests();
+    run_frame_database_tests();
+    run_paging_tests();
+    run_virtual_range_allocator_tests();
+    run_kernel_heap_tests();
+    run_heap_profiler_tests();
+    run_kmem_cache_tests();
+    run_arena_tests();
+    run_operator_new_tests();
 
     foros::vga::scrolling_printer() << "All tests passed\n";
+
+    run_frame_allocator_benchmarks();
+    run_paging_benchmarks();
 }